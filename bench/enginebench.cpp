@@ -0,0 +1,495 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+// Engine throughput over the in-memory loopback transport, without
+// sockets or TLS: two engines back to back, each driven by a sender
+// and a receiver thread.
+//
+//   zway_bench [bandwidth MB/s] [latency ms]
+//
+// Measures requests per second, MB/s of plain and encrypted resource
+// streams across packet body sizes, and the CPU time per packet.
+
+#include "Zway/engine.h"
+#include "Zway/loopbacktransport.h"
+#include "Zway/bufferreceiver.h"
+#include "Zway/buffersender.h"
+#include "Zway/memorybuffer.h"
+#include "Zway/message/resource.h"
+#include "Zway/message/resourcereceiver.h"
+#include "Zway/message/resourcesender.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+using namespace Zway;
+
+const uint32_t NUM_REQUESTS = 20000;
+
+const uint32_t STREAM_SIZE = 8 * 1048576;
+
+const uint32_t NUM_STREAMS = 8;
+
+const uint32_t FIRST_STREAM_ID = 0x40000000;
+
+const uint32_t STALL_TIMEOUT = 10;
+
+// ============================================================ //
+
+/**
+ * @brief The BenchEngine class
+ *
+ * Answers every incoming request and receives resource streams,
+ * plain or encrypted, counting what arrived.
+ */
+
+class BenchEngine : public Engine
+{
+public:
+
+    BenchEngine(Transport$ transport)
+        : m_streamsReceived(0),
+          m_bytesReceived(0),
+          m_transport(transport),
+          m_running(false),
+          m_encrypted(false)
+    {
+        m_key = MemoryBuffer::create(nullptr, 32);
+
+        m_salt = MemoryBuffer::create(nullptr, 16);
+    }
+
+    void start()
+    {
+        m_running = true;
+
+        m_sendThread = std::thread([this] () {
+
+            while (m_running) {
+
+                if (sendPackets(m_transport) <= 0) {
+
+                    std::unique_lock<std::mutex> lock(m_mutex);
+
+                    m_condition.wait_for(lock, std::chrono::milliseconds(10), [this] () {
+
+                        return !m_running || numStreamSenders() > 0;
+                    });
+                }
+            }
+        });
+
+        m_receiveThread = std::thread([this] () {
+
+            while (m_running) {
+
+                receivePacket(m_transport, 100);
+            }
+        });
+    }
+
+    void stop()
+    {
+        m_running = false;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_condition.notify_all();
+        }
+
+        m_transport->close();
+
+        m_sendThread.join();
+
+        m_receiveThread.join();
+    }
+
+    bool addStreamSender(StreamSender$ sender)
+    {
+        if (!Engine::addStreamSender(sender)) {
+
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_condition.notify_all();
+
+        return true;
+    }
+
+    void setEncrypted(bool encrypted)
+    {
+        m_encrypted = encrypted;
+    }
+
+    MemoryBuffer$ m_key;
+
+    MemoryBuffer$ m_salt;
+
+    std::atomic<uint32_t> m_streamsReceived;
+
+    std::atomic<uint64_t> m_bytesReceived;
+
+protected:
+
+    bool processIncomingRequest(const UBJ::Object &request)
+    {
+        return postRequestSuccess(request["requestId"].toInt());
+    }
+
+    StreamReceiver$ createStreamReceiver(const Packet &pkt)
+    {
+        if (pkt.streamType() != Packet::Resource) {
+
+            return Engine::createStreamReceiver(pkt);
+        }
+
+        BufferReceiverCallback callback = [this] (BufferReceiver$ receiver, MemoryBuffer$, uint32_t) {
+
+            if (receiver->status() == StreamReceiver::Completed) {
+
+                m_bytesReceived += receiver->bytesReceived();
+
+                m_streamsReceived++;
+            }
+        };
+
+        if (m_encrypted) {
+
+            return ResourceReceiver::create(pkt, m_key, m_salt, callback);
+        }
+
+        return BufferReceiver::create(pkt, nullptr, callback);
+    }
+
+protected:
+
+    Transport$ m_transport;
+
+    std::atomic<bool> m_running;
+
+    std::atomic<bool> m_encrypted;
+
+    std::thread m_sendThread;
+
+    std::thread m_receiveThread;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_condition;
+};
+
+/**
+ * @brief The BenchRequest class
+ */
+
+class BenchRequest : public Request
+{
+public:
+
+    BenchRequest(uint32_t id, std::atomic<uint32_t> &responses)
+        : Request(Dispatch, UBJ_OBJ("requestId" << id)),
+          m_responses(responses)
+    {
+    }
+
+    bool processResponse(const UBJ::Object &response)
+    {
+        (void)response;
+
+        m_responses++;
+
+        return true;
+    }
+
+protected:
+
+    std::atomic<uint32_t> &m_responses;
+};
+
+/**
+ * @brief The Bench class
+ */
+
+class Bench
+{
+public:
+
+    Bench(uint64_t bandwidth, uint32_t latency)
+    {
+        LoopbackTransport::Pair pair = LoopbackTransport::createPair(bandwidth, latency);
+
+        m_transports = pair;
+
+        m_client = std::make_shared<BenchEngine>(pair.first);
+
+        m_server = std::make_shared<BenchEngine>(pair.second);
+
+        m_client->setPacketBodySize(MAX_JUMBO_PACKET_BODY);
+
+        m_server->setPacketBodySize(MAX_JUMBO_PACKET_BODY);
+
+        m_client->start();
+
+        m_server->start();
+    }
+
+    ~Bench()
+    {
+        m_client->stop();
+
+        m_server->stop();
+    }
+
+    bool requests()
+    {
+        std::atomic<uint32_t> responses(0);
+
+        Clock clock;
+
+        for (uint32_t id=1; id<=NUM_REQUESTS; ++id) {
+
+            m_client->postRequest(Request$(new BenchRequest(id, responses)));
+        }
+
+        if (!wait([&responses] () { return (uint64_t)responses; }, NUM_REQUESTS)) {
+
+            printf("requests stalled at %u of %u responses\n", (uint32_t)responses, NUM_REQUESTS);
+
+            return false;
+        }
+
+        printf("requests      %10.0f req/s %10.2f us/packet\n",
+               NUM_REQUESTS / clock.seconds(),
+               clock.cpu() * 1e6 / packets());
+
+        return true;
+    }
+
+    bool streams(bool encrypted, uint32_t bodySize)
+    {
+        m_server->setEncrypted(encrypted);
+
+        m_server->m_streamsReceived = 0;
+
+        m_server->m_bytesReceived = 0;
+
+        Clock clock;
+
+        uint64_t packetsBefore = packets();
+
+        for (uint32_t i=0; i<NUM_STREAMS; ++i) {
+
+            uint32_t id = FIRST_STREAM_ID + m_nextStream++;
+
+            if (encrypted) {
+
+                Resource$ res = FileSystemResource::create(m_path);
+
+                res->setId(id);
+
+                m_client->addStreamSender(ResourceSender::create(res, m_client->m_key, m_client->m_salt, nullptr, bodySize));
+            }
+            else {
+
+                StreamSender$ sender = BufferSender::create(id, Packet::Resource, m_data);
+
+                sender->setBodySize(bodySize);
+
+                m_client->addStreamSender(sender);
+            }
+        }
+
+        if (!wait([this] () { return (uint64_t)m_server->m_streamsReceived; }, NUM_STREAMS)) {
+
+            printf("streams stalled at %u of %u\n", (uint32_t)m_server->m_streamsReceived, NUM_STREAMS);
+
+            return false;
+        }
+
+        printf("%-9s %7u %10.1f MB/s  %10.2f us/packet\n",
+               encrypted ? "aes" : "plain",
+               bodySize,
+               m_server->m_bytesReceived / clock.seconds() / 1048576,
+               clock.cpu() * 1e6 / (packets() - packetsBefore));
+
+        return true;
+    }
+
+    bool prepare()
+    {
+        m_data = MemoryBuffer::create(nullptr, STREAM_SIZE);
+
+        char path[] = "/tmp/zway_bench_XXXXXX";
+
+        int fd = mkstemp(path);
+
+        if (fd < 0 || ftruncate(fd, STREAM_SIZE) != 0) {
+
+            return false;
+        }
+
+        ::close(fd);
+
+        m_path = path;
+
+        return m_data != nullptr;
+    }
+
+    void cleanup()
+    {
+        unlink(m_path.c_str());
+    }
+
+protected:
+
+    struct Clock
+    {
+        Clock()
+            : m_start(std::chrono::steady_clock::now()),
+              m_cpu(std::clock())
+        {
+        }
+
+        double seconds()
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        }
+
+        double cpu()
+        {
+            return double(std::clock() - m_cpu) / CLOCKS_PER_SEC;
+        }
+
+        std::chrono::steady_clock::time_point m_start;
+
+        std::clock_t m_cpu;
+    };
+
+    /**
+     * Waits for count to reach target, fails once no packet moved
+     * for STALL_TIMEOUT seconds.
+     */
+
+    bool wait(std::function<uint64_t ()> count, uint64_t target)
+    {
+        uint64_t last = packets();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(STALL_TIMEOUT);
+
+        while (count() < target) {
+
+            if (std::chrono::steady_clock::now() > deadline) {
+
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            uint64_t current = packets();
+
+            if (current != last) {
+
+                last = current;
+
+                deadline = std::chrono::steady_clock::now() + std::chrono::seconds(STALL_TIMEOUT);
+            }
+        }
+
+        return true;
+    }
+
+    uint64_t packets()
+    {
+        return m_transports.first->packetsSent() + m_transports.second->packetsSent();
+    }
+
+protected:
+
+    LoopbackTransport::Pair m_transports;
+
+    std::shared_ptr<BenchEngine> m_client;
+
+    std::shared_ptr<BenchEngine> m_server;
+
+    MemoryBuffer$ m_data;
+
+    std::string m_path;
+
+    uint32_t m_nextStream = 0;
+};
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint64_t bandwidth = argc > 1 ? atoll(argv[1]) * 1048576 : 0;
+
+    uint32_t latency = argc > 2 ? atoi(argv[2]) : 0;
+
+    Bench bench(bandwidth, latency);
+
+    if (!bench.prepare()) {
+
+        printf("failed to prepare stream data\n");
+
+        return 1;
+    }
+
+    if (!bench.requests()) {
+
+        bench.cleanup();
+
+        return 1;
+    }
+
+    // packet body size sweep, 4 KiB up to jumbo packets
+
+    for (bool encrypted : {false, true}) {
+
+        for (uint32_t bodySize = 4096; bodySize <= MAX_JUMBO_PACKET_BODY; bodySize *= 4) {
+
+            if (!bench.streams(encrypted, bodySize)) {
+
+                bench.cleanup();
+
+                return 1;
+            }
+        }
+    }
+
+    bench.cleanup();
+
+    return 0;
+}
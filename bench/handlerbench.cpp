@@ -0,0 +1,283 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+
+// Stress test of Handler<T> wake-ups. Producers post elements in short
+// bursts with pauses in between, so that the handler keeps going idle
+// and posts race its wait. Every element carries the time it was posted,
+// the handler checks the per-producer order and records the hand-off
+// latency in a histogram. A lost wake-up shows as a stall, or as a tail
+// in the histogram that reaches the pause between bursts.
+//
+//   zway_handler_bench [producers] [elements per producer]
+
+#include "Zway/thread/handler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace Zway;
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t NUM_BUCKETS = 22;
+
+// ============================================================ //
+
+/**
+ * @brief The Sample struct
+ */
+
+struct Sample
+{
+    uint32_t producer;
+
+    uint32_t seq;
+
+    Clock::time_point posted;
+};
+
+/**
+ * @brief The BenchHandler class
+ *
+ * Bucket i counts latencies below 2^i microseconds, the last one the
+ * rest.
+ */
+
+class BenchHandler : public Handler<Sample>
+{
+public:
+
+    BenchHandler(uint32_t producers)
+        : m_next(producers, 0),
+          m_buckets(NUM_BUCKETS, 0),
+          m_received(0),
+          m_disordered(0),
+          m_max(0)
+    {
+
+    }
+
+    uint64_t received()
+    {
+        return m_received.load(std::memory_order_acquire);
+    }
+
+    uint64_t disordered()
+    {
+        return m_disordered;
+    }
+
+    uint64_t max()
+    {
+        return m_max;
+    }
+
+    const std::vector<uint64_t> &buckets()
+    {
+        return m_buckets;
+    }
+
+protected:
+
+    void process(Sample &sample)
+    {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sample.posted).count();
+
+        uint32_t i = 0;
+
+        while (i < NUM_BUCKETS - 1 && us >= (1ull << i)) {
+
+            ++i;
+        }
+
+        m_buckets[i]++;
+
+        if (us > m_max) {
+
+            m_max = us;
+        }
+
+        if (sample.seq != m_next[sample.producer]) {
+
+            m_disordered++;
+        }
+
+        m_next[sample.producer] = sample.seq + 1;
+
+        m_received.fetch_add(1, std::memory_order_release);
+    }
+
+protected:
+
+    std::vector<uint32_t> m_next;
+
+    std::vector<uint64_t> m_buckets;
+
+    std::atomic<uint64_t> m_received;
+
+    uint64_t m_disordered;
+
+    uint64_t m_max;
+};
+
+/**
+ * @brief percentile
+ * @param buckets
+ * @param total
+ * @param p
+ * @return upper bound of the bucket holding the percentile in us
+ */
+
+uint64_t percentile(const std::vector<uint64_t> &buckets, uint64_t total, double p)
+{
+    uint64_t n = 0;
+
+    for (uint32_t i=0; i<buckets.size(); ++i) {
+
+        n += buckets[i];
+
+        if (n >= total * p) {
+
+            return 1ull << i;
+        }
+    }
+
+    return 1ull << (buckets.size() - 1);
+}
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint32_t producers = argc > 1 ? atoi(argv[1]) : 4;
+
+    uint32_t count = argc > 2 ? atoi(argv[2]) : 200000;
+
+    if (!producers) {
+
+        producers = 1;
+    }
+
+    BenchHandler handler(producers);
+
+    handler.start();
+
+    auto start = Clock::now();
+
+    std::vector<std::thread> threads;
+
+    for (uint32_t p=0; p<producers; ++p) {
+
+        threads.emplace_back([&handler, p, count] () {
+
+            uint32_t x = 2463534242u + p;
+
+            for (uint32_t i=0; i<count;) {
+
+                // bursts of 1-32 elements, then up to 100us of quiet
+
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+
+                for (uint32_t n = 1 + (x & 31); n && i < count; --n, ++i) {
+
+                    handler.post(Sample{p, i, Clock::now()});
+                }
+
+                uint32_t pause = (x >> 8) % 101;
+
+                if (pause) {
+
+                    std::this_thread::sleep_for(std::chrono::microseconds(pause));
+                }
+            }
+        });
+    }
+
+    for (auto &it : threads) {
+
+        it.join();
+    }
+
+    uint64_t total = (uint64_t)producers * count;
+
+    // every element has been posted, all must arrive without a further post
+
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+
+    while (handler.received() < total && Clock::now() < deadline) {
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t received = handler.received();
+
+    handler.cancelAndJoin();
+
+    const std::vector<uint64_t> &buckets = handler.buckets();
+
+    printf("%u producers, %llu elements in %.3f s\n", producers, (unsigned long long)total, seconds);
+
+    printf("\n%15s %12s %8s\n", "latency", "elements", "%");
+
+    for (uint32_t i=0; i<buckets.size(); ++i) {
+
+        if (buckets[i]) {
+
+            printf("%3s %8llu us %12llu %8.3f\n",
+                   i == buckets.size() - 1 ? ">=" : "<",
+                   (unsigned long long)(i == buckets.size() - 1 ? 1ull << (i - 1) : 1ull << i),
+                   (unsigned long long)buckets[i], 100.0 * buckets[i] / received);
+        }
+    }
+
+    printf("\np50 < %llu us, p99 < %llu us, p99.9 < %llu us, max %llu us\n",
+           (unsigned long long)percentile(buckets, received, 0.5),
+           (unsigned long long)percentile(buckets, received, 0.99),
+           (unsigned long long)percentile(buckets, received, 0.999),
+           (unsigned long long)handler.max());
+
+    if (received < total) {
+
+        printf("stalled, %llu of %llu elements arrived\n", (unsigned long long)received, (unsigned long long)total);
+
+        return 1;
+    }
+
+    if (handler.disordered()) {
+
+        printf("%llu elements out of order\n", (unsigned long long)handler.disordered());
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+// Push/pop throughput of the lock-free MpscQueue against the mutex
+// guarded std::list the handlers used before, with several producer
+// threads and one consumer.
+//
+//   zway_queue_bench [elements per producer]
+
+#include "Zway/thread/queue.h"
+#include "Zway/thread/safe.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <thread>
+#include <vector>
+
+using namespace Zway;
+
+using Element = std::shared_ptr<uint64_t>;
+
+// ============================================================ //
+
+/**
+ * @brief The ListQueue class
+ *
+ * The previous hand-off, a std::list behind a mutex.
+ */
+
+class ListQueue
+{
+public:
+
+    bool push(Element &&element)
+    {
+        MutexLocker lock(m_list);
+
+        m_list->push_back(std::move(element));
+
+        return true;
+    }
+
+    bool pop(Element &element)
+    {
+        MutexLocker lock(m_list);
+
+        if (m_list->empty()) {
+
+            return false;
+        }
+
+        element = std::move(m_list->front());
+
+        m_list->pop_front();
+
+        return true;
+    }
+
+protected:
+
+    ThreadSafe<std::list<Element>> m_list;
+};
+
+/**
+ * @brief run
+ * @param queue
+ * @param producers
+ * @param count
+ * @return elements per second
+ */
+
+template <typename Q>
+double run(Q &queue, uint32_t producers, uint32_t count)
+{
+    std::vector<std::vector<Element>> elements(producers);
+
+    for (auto &it : elements) {
+
+        for (uint32_t i=0; i<count; ++i) {
+
+            it.push_back(std::make_shared<uint64_t>(i));
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+
+    for (uint32_t p=0; p<producers; ++p) {
+
+        threads.emplace_back([&queue, &elements, p] () {
+
+            for (auto &element : elements[p]) {
+
+                while (!queue.push(std::move(element))) {
+
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    uint64_t total = (uint64_t)producers * count;
+
+    uint64_t sum = 0;
+
+    Element element;
+
+    for (uint64_t n=0; n<total;) {
+
+        if (queue.pop(element)) {
+
+            sum += *element;
+
+            n++;
+        }
+        else {
+
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto &it : threads) {
+
+        it.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (sum != producers * ((uint64_t)count * (count - 1) / 2)) {
+
+        printf("checksum mismatch\n");
+    }
+
+    return total / seconds;
+}
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    printf("%10s %16s %16s\n", "producers", "list+mutex/s", "mpsc/s");
+
+    for (uint32_t producers : {1, 2, 4, 8}) {
+
+        ListQueue list;
+
+        MpscQueue<Element> mpsc(4096);
+
+        double a = run(list, producers, count);
+
+        double b = run(mpsc, producers, count);
+
+        printf("%10u %16.0f %16.0f\n", producers, a, b);
+    }
+
+    return 0;
+}
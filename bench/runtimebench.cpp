@@ -0,0 +1,269 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+// Overhead of many idle clients, each on threads of its own versus
+// all of them on a ClientRuntime. The clients connect to a local
+// socket which accepts but never answers, so they sit in the tls
+// handshake like accounts waiting for traffic.
+//
+//   zway_runtime_bench [clients] [seconds]
+//
+// Reports threads, resident and virtual memory, cpu time and context
+// switches of the process while the clients idle.
+
+#include "Zway/client.h"
+#include "Zway/clientruntime.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Zway;
+
+// ============================================================ //
+
+/**
+ * @brief The Usage struct
+ */
+
+struct Usage
+{
+    uint64_t threads;
+
+    uint64_t rss;
+
+    uint64_t vsize;
+
+    uint64_t cpuTime;
+
+    uint64_t switches;
+};
+
+/**
+ * @brief statusValue
+ * @param key
+ * @return value of a line in /proc/self/status
+ */
+
+static uint64_t statusValue(const std::string &key)
+{
+    std::ifstream status("/proc/self/status");
+
+    std::string line;
+
+    while (std::getline(status, line)) {
+
+        if (line.compare(0, key.size(), key) == 0) {
+
+            return strtoull(line.c_str() + key.size() + 1, nullptr, 10);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief usage
+ * @return
+ */
+
+static Usage usage()
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    Usage u;
+
+    u.threads = statusValue("Threads");
+
+    u.rss = statusValue("VmRSS");
+
+    u.vsize = statusValue("VmSize");
+
+    u.cpuTime = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ull + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+
+    u.switches = ru.ru_nvcsw + ru.ru_nivcsw;
+
+    return u;
+}
+
+/**
+ * @brief listenLocal
+ * @param port
+ * @return
+ */
+
+static int32_t listenLocal(uint16_t &port)
+{
+    int32_t s = socket(AF_INET, SOCK_STREAM, 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    socklen_t len = sizeof(addr);
+
+    if (bind(s, (struct sockaddr*)&addr, len) || listen(s, SOMAXCONN) ||
+        getsockname(s, (struct sockaddr*)&addr, &len)) {
+
+        close(s);
+
+        return -1;
+    }
+
+    port = ntohs(addr.sin_port);
+
+    return s;
+}
+
+/**
+ * @brief run
+ * @param numClients
+ * @param seconds
+ * @param port
+ * @param runtime
+ */
+
+static void run(uint32_t numClients, uint32_t seconds, uint16_t port, ClientRuntime$ runtime)
+{
+    Usage before = usage();
+
+    std::vector<Client$> clients;
+
+    for (uint32_t i=0; i<numClients; ++i) {
+
+        Client$ client = Client::create();
+
+        client->start("127.0.0.1", port, runtime);
+
+        clients.push_back(client);
+    }
+
+    // let them connect, then measure while idle
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    Usage start = usage();
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    Usage end = usage();
+
+    double cpuTime = (end.cpuTime - start.cpuTime) / 1000.0;
+
+    printf("%-10s %8llu %10llu %12llu %10.1f %10llu %14.3f\n",
+           runtime ? "runtime" : "threads",
+           (unsigned long long)end.threads,
+           (unsigned long long)(end.rss - before.rss),
+           (unsigned long long)(end.vsize - before.vsize),
+           cpuTime / seconds,
+           (unsigned long long)((end.switches - start.switches) / seconds),
+           cpuTime / seconds / numClients);
+
+    if (runtime) {
+
+        UBJ::Object stats = runtime->stats();
+
+        printf("\nruntime: %u threads for %u clients instead of %u, %llu KiB of stack address space not reserved, %llu KiB per client\n\n",
+               (uint32_t)stats["threads"].toInt(),
+               (uint32_t)stats["clients"].toInt(),
+               (uint32_t)stats["dedicatedThreads"].toInt(),
+               (unsigned long long)stats["stackReserveSaved"].toLong() / 1024,
+               (unsigned long long)stats["stackReserveSavedPerClient"].toLong() / 1024);
+    }
+
+    // interrupt all of them first, closing one by one would wait for each
+
+    for (auto &client : clients) {
+
+        client->cancel();
+    }
+
+    for (auto &client : clients) {
+
+        client->close();
+    }
+}
+
+/**
+ * @brief main
+ * @param argc
+ * @param argv
+ * @return
+ */
+
+int main(int argc, char *argv[])
+{
+    uint32_t numClients = argc > 1 ? atoi(argv[1]) : 200;
+
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 3;
+
+    uint16_t port = 0;
+
+    int32_t s = listenLocal(port);
+
+    if (s == -1) {
+
+        printf("failed to listen\n");
+
+        return 1;
+    }
+
+    Client::startup();
+
+    printf("%u idle clients, %u s\n\n", numClients, seconds);
+
+    printf("%-10s %8s %10s %12s %10s %10s %14s\n",
+           "mode", "threads", "rss KiB", "vsize KiB", "cpu ms/s", "csw/s", "cpu ms/s/client");
+
+    run(numClients, seconds, port, nullptr);
+
+    ClientRuntime$ runtime = ClientRuntime::create();
+
+    run(numClients, seconds, port, runtime);
+
+    runtime->stop();
+
+    Client::cleanup();
+
+    close(s);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_BUFFER_POOL_H_
+#define ZWAY_CORE_BUFFER_POOL_H_
+
+#include "Zway/thread/safe.h"
+#include "Zway/packet.h"
+
+#include <list>
+
+namespace Zway {
+
+USING_SHARED_PTR(BufferPool)
+USING_SHARED_PTR(MemoryBuffer)
+
+// ============================================================ //
+
+/**
+ * @brief The BufferPool class
+ *
+ * Hands out fixed-size memory buffers which return to the pool
+ * (securely cleared) as soon as the last reference is released.
+ */
+
+class BufferPool : public std::enable_shared_from_this<BufferPool>
+{
+public:
+
+    static BufferPool$ create(uint32_t bufferSize, uint32_t maxIdle = 0);
+
+    static BufferPool$ packetPool(uint32_t size = MAX_PACKET_BODY);
+
+    MemoryBuffer$ lease();
+
+    uint32_t bufferSize();
+
+    uint32_t numIdle();
+
+protected:
+
+    BufferPool(uint32_t bufferSize, uint32_t maxIdle);
+
+    void release(MemoryBuffer$ buffer);
+
+protected:
+
+    uint32_t m_bufferSize;
+
+    uint32_t m_maxIdle;
+
+    ThreadSafe<std::list<MemoryBuffer$>> m_idle;
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -54,6 +54,8 @@ public:
 
     uint32_t bytesReceived();
 
+    MemoryBuffer$ packetBuffer(const Packet &pkt, uint32_t &offset);
+
 protected:
 
     BufferReceiver(BufferReceiverCallback callback = nullptr);
@@ -72,6 +74,8 @@ protected:
 
     uint32_t m_bytesReceived;
 
+    uint32_t m_bodySize;
+
 };
 
 // ============================================================ //
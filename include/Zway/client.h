@@ -27,8 +27,14 @@
 #ifndef ZWAY_CLIENT_H_
 #define ZWAY_CLIENT_H_
 
+#include "Zway/connector.h"
 #include "Zway/engine.h"
 #include "Zway/event/eventhandler.h"
+#include "Zway/reactor.h"
+#include "Zway/resolver.h"
+#include "Zway/thread/executor.h"
+
+#include <chrono>
 
 #if defined _WIN32
 #include <windows.h>
@@ -40,9 +46,36 @@ namespace Zway {
 
 USING_SHARED_PTR(Store)
 USING_SHARED_PTR(Message)
+USING_SHARED_PTR(PushRequest)
+USING_SHARED_PTR(ClientRuntime)
 
 extern const uint16_t ZWAY_PORT;
 extern const uint32_t RECONNECT_INTERVAL;
+extern const uint32_t CONNECT_TIMEOUT;
+
+extern const uint32_t MAX_STEP_PACKETS;
+
+extern const uint32_t MAX_STEP_BATCHES;
+
+extern const uint32_t MAX_CORKED_BYTES;
+
+extern const uint32_t MAX_SEND_WINDOW;
+
+extern const uint32_t RECEIVE_QUEUE_HIGH_WATERMARK;
+
+extern const uint32_t RECEIVE_QUEUE_LOW_WATERMARK;
+
+extern const uint32_t RECEIVE_QUEUE_CAPACITY;
+
+extern const uint32_t RECEIVE_BUFFER_SIZE;
+
+extern const uint32_t RECEIVE_DIRECT_SIZE;
+
+extern const uint32_t MAX_RESOURCE_UPLOADS;
+
+extern const uint32_t MAX_MESSAGE_RESOURCE_UPLOADS;
+
+extern const uint32_t MAX_CLIENT_WORKERS;
 
 // ============================================================ //
 
@@ -54,21 +87,44 @@ class Sender : public Handler<Packet$>
 {
 public:
 
+    enum PumpResult {
+
+        Failed = -1,
+
+        Blocked,
+
+        Done,
+
+        More
+    };
+
     Sender(Client *client);
 
     uint32_t numPackets();
 
+    uint32_t queuedBytes();
+
+    PumpResult pump();
+
 protected:
 
     void process(Packet$ &packet);
 
     bool getElements();
 
+    void cleared();
+
+    bool fillWindow();
+
     uint32_t sendPacket(Packet$ pkt);
 
 protected:
 
     Client *m_client;
+
+    uint32_t m_corkedBytes;
+
+    std::atomic<uint32_t> m_queuedBytes;
 };
 
 /**
@@ -91,25 +147,96 @@ public:
 
     uint32_t numPackets();
 
-protected:
+    void setWatermarks(uint32_t low, uint32_t high);
+
+    UBJ::Object stats();
 
     void notify();
 
+    int32_t readPacket(Packet &pkt);
+
+    void resetRead();
+
+protected:
+
+    struct QueuedPacket
+    {
+        Packet packet;
+
+        uint32_t bytes;
+    };
+
+protected:
+
+    bool waitDrained(uint32_t ms);
+
+    void resumeReading();
+
+    bool waitPush(QueuedPacket &queued);
+
     void run();
 
-    uint32_t recvPacket(Packet &pkt);
+    int32_t fill();
+
+    uint32_t take(uint8_t *data, uint32_t size);
+
+    MemoryBuffer$ bodyBuffer(const Packet &pkt, uint32_t &offset);
 
 protected:
 
     Client *m_client;
 
-    ThreadSafe<bool> m_busy;
+    std::atomic<bool> m_busy;
+
+    std::atomic<bool> m_waiting;
+
+    std::atomic<bool> m_signaled;
+
+    MpscQueue<QueuedPacket> m_packetQueue;
+
+    std::atomic<uint32_t> m_queuedBytes;
+
+    std::atomic<uint32_t> m_lowWatermark;
+
+    std::atomic<uint32_t> m_highWatermark;
+
+    std::atomic<bool> m_paused;
+
+    std::atomic<bool> m_queueFull;
 
-    ThreadSafe<std::list<Packet>> m_packetQueue;
+    std::mutex m_flowMutex;
+
+    uint32_t m_numPauses;
+
+    uint64_t m_pausedTime;
+
+    std::chrono::steady_clock::time_point m_pausedSince;
+
+    std::condition_variable m_drainedCondition;
 
     std::mutex m_waitMutex;
 
     std::condition_variable m_waitCondition;
+
+    Packet m_readPacket;
+
+    uint32_t m_readOffset;
+
+    MemoryBuffer$ m_readBody;
+
+    uint32_t m_readBodyOffset;
+
+    MemoryBuffer$ m_buffer;
+
+    uint32_t m_bufferBegin;
+
+    uint32_t m_bufferEnd;
+
+    bool m_bufferCharged;
+
+    std::atomic<uint32_t> m_numReads;
+
+    std::atomic<uint32_t> m_numReadPackets;
 };
 
 /**
@@ -161,10 +288,12 @@ public:
     virtual ~Client();
 
 
-    bool start(const std::string& host, uint16_t port = ZWAY_PORT);
+    bool start(const std::string& host, uint16_t port = ZWAY_PORT, ClientRuntime$ runtime = nullptr);
 
     bool close();
 
+    void cancel();
+
 
     void setStore(Store$ store);
 
@@ -194,6 +323,28 @@ public:
 
     uint32_t contactStatus(uint32_t contactId);
 
+    void setResourceUploadWindow(uint32_t perMessage, uint32_t total);
+
+    uint32_t resourceUploadWindow();
+
+    void setReceiveWatermarks(uint32_t low, uint32_t high);
+
+    UBJ::Object receiveStats();
+
+    void setSessionPersistence(bool persist);
+
+    bool sessionPersistence();
+
+    UBJ::Object connectionStats();
+
+    void setKernelTls(bool enable);
+
+    bool kernelTls();
+
+    void setResolver(Resolver$ resolver);
+
+    Resolver$ resolver();
+
 
 protected:
 
@@ -206,9 +357,31 @@ protected:
 
     void run();
 
+    uint32_t step();
+
 
     bool connect(const std::string& host, uint32_t port);
 
+    void resolve(const std::string& host, uint32_t port);
+
+    int32_t resolveResult(Resolver::AddressList &addresses, uint32_t ms=0);
+
+    bool watch(intptr_t socket, bool watch);
+
+    void connectFailed();
+
+    bool initSession();
+
+    int32_t handshake();
+
+    void secured();
+
+    std::string sessionKey();
+
+    void loadSession();
+
+    void saveSession();
+
     bool reconnect();
 
     bool disconnect(bool bye=true, bool event=true);
@@ -224,15 +397,27 @@ protected:
 
     uint32_t send(uint8_t* data, uint32_t size);
 
-    uint32_t recv(uint8_t* data, uint32_t size);
+    uint32_t sendFile(int32_t fd, uint32_t offset, uint32_t size);
+
+    void cork();
+
+    int32_t uncork(bool block=true);
+
+    int32_t recvSome(uint8_t* data, uint32_t size);
 
 
     bool processIncomingRequest(const UBJ::Object &request);
 
+    bool dispatchIncomingRequest(const UBJ::Object &request);
+
+    uint64_t dispatchKey(const UBJ::Object &request);
+
     StreamReceiver$ createStreamReceiver(const Packet &packet);
 
     bool processRequestTimeout(Request$ request);
 
+    void wake();
+
 
     bool processDispatchRequest(const UBJ::Object &request);
 
@@ -248,6 +433,10 @@ protected:
 
     bool processMessage(const UBJ::Object &request, const UBJ::Object &meta, uint32_t numResources);
 
+    bool acquireResourceUpload(PushRequest$ request);
+
+    void releaseResourceUpload();
+
   //void parseCert();
 
 
@@ -270,6 +459,10 @@ protected:
 
     /*gnutls_certificate_credentials_t*/ void* m_certCred;
 
+    bool m_corked;
+
+    Reactor m_reactor;
+
 
     std::string m_host;
 
@@ -280,6 +473,54 @@ protected:
 
     Receiver m_receiver;
 
+    Executor m_executor;
+
+    ClientRuntime$ m_runtime;
+
+    uint32_t m_runtimeId;
+
+    std::chrono::steady_clock::time_point m_reconnectTime;
+
+    std::chrono::steady_clock::time_point m_connectDeadline;
+
+
+    Resolver$ m_resolver;
+
+    Resolver::AddressList m_addresses;
+
+    uint32_t m_resolveGeneration;
+
+    bool m_resolved;
+
+    bool m_resolving;
+
+    std::mutex m_resolveMutex;
+
+    std::condition_variable m_resolveCondition;
+
+    Connector m_connector;
+
+
+    ThreadSafe<std::map<std::string, MemoryBuffer$>> m_sessionCache;
+
+    std::atomic<bool> m_persistSessions;
+
+    std::chrono::steady_clock::time_point m_connectStart;
+
+    std::chrono::steady_clock::time_point m_handshakeStart;
+
+    std::atomic<uint32_t> m_numHandshakes;
+
+    std::atomic<uint32_t> m_numResumed;
+
+    std::atomic<uint32_t> m_handshakeTime;
+
+    std::atomic<uint32_t> m_authTime;
+
+    std::atomic<bool> m_kernelTls;
+
+    std::atomic<bool> m_kernelTlsActive;
+
     EventHandler$ m_eventHandler;
 
 
@@ -289,16 +530,31 @@ protected:
     ThreadSafe<std::map<uint32_t, uint32_t>> m_contactStatus;
 
 
+    std::mutex m_resourceUploadMutex;
+
+    uint32_t m_resourceUploads;
+
+    uint32_t m_maxResourceUploads;
+
+    uint32_t m_maxMessageResourceUploads;
+
+    std::list<std::weak_ptr<PushRequest>> m_resourceUploadQueue;
+
+
     friend class Sender;
 
     friend class Receiver;
 
+    friend class ClientRuntime;
+
     friend class LoginRequest;
 
     friend class LogoutRequest;
 
     friend class AcceptContactRequest;
 
+    friend class PushRequest;
+
 };
 
 // ============================================================ //
@@ -0,0 +1,157 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_CLIENT_RUNTIME_H_
+#define ZWAY_CORE_CLIENT_RUNTIME_H_
+
+#include "Zway/thread/executor.h"
+#include "Zway/ubj/value.h"
+#include "Zway/util/timingwheel.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace Zway {
+
+USING_SHARED_PTR(Client)
+USING_SHARED_PTR(ClientRuntime)
+
+extern const uint32_t RUNTIME_POLL_INTERVAL;
+
+// ============================================================ //
+
+/**
+ * @brief The ClientRuntime class
+ *
+ * Runs many clients on a fixed set of threads instead of the client,
+ * sender, receiver and worker threads each client starts on its own.
+ * A poller thread waits for socket events and deadlines of all clients
+ * and schedules their steps, which never block, on the io threads.
+ * Steps of one client run one after another. Incoming requests are
+ * handled on a shared pool of worker threads.
+ *
+ * On Linux the sockets are watched with epoll, other platforms give
+ * every connected client a step each RUNTIME_POLL_INTERVAL instead.
+ */
+
+class ClientRuntime
+{
+public:
+
+    static ClientRuntime$ create(uint32_t numIoThreads = 0, uint32_t numWorkers = 0);
+
+    ~ClientRuntime();
+
+    bool start();
+
+    void stop();
+
+    bool add(Client$ client);
+
+    Client$ remove(uint32_t id);
+
+    void schedule(uint32_t id);
+
+    bool watch(uint32_t id, intptr_t socket);
+
+    void unwatch(intptr_t socket);
+
+    Executor &workers();
+
+    uint64_t dispatchKey(uint32_t id, uint64_t key);
+
+    uint32_t numClients();
+
+    UBJ::Object stats();
+
+protected:
+
+    struct Slot
+    {
+        Client$ client;
+
+        std::atomic<bool> scheduled;
+
+        std::mutex stepMutex;
+
+        bool removed;
+    };
+
+    using Slot$ = std::shared_ptr<Slot>;
+
+    ClientRuntime(uint32_t numIoThreads, uint32_t numWorkers);
+
+    void run();
+
+    void step(Slot$ slot, uint32_t id);
+
+    void setTimer(uint32_t id, uint32_t ms);
+
+    void interrupt();
+
+protected:
+
+    uint32_t m_numIoThreads;
+
+    uint32_t m_numWorkers;
+
+    Executor m_io;
+
+    Executor m_workers;
+
+    std::thread m_poller;
+
+    std::atomic<bool> m_running;
+
+    int32_t m_pollFd;
+
+    int32_t m_wakeFd;
+
+    std::mutex m_mutex;
+
+    std::unordered_map<uint32_t, Slot$> m_slots;
+
+    uint32_t m_nextId;
+
+    std::mutex m_timerMutex;
+
+    TimingWheel m_timers;
+
+    uint64_t m_pollDeadline;
+
+    std::atomic<uint64_t> m_numSteps;
+
+    std::atomic<uint64_t> m_stepTime;
+};
+
+// ============================================================ //
+
+}
+
+#endif
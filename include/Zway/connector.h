@@ -0,0 +1,97 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_CONNECTOR_H_
+#define ZWAY_CORE_CONNECTOR_H_
+
+#include "Zway/resolver.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace Zway {
+
+extern const uint32_t CONNECT_ATTEMPT_DELAY;
+
+// ============================================================ //
+
+/**
+ * @brief The Connector class
+ *
+ * Races non-blocking connects to the resolved addresses of a host as
+ * happy eyeballs does (RFC 8305): the next address is tried when the
+ * attempts in flight failed or did not finish within
+ * CONNECT_ATTEMPT_DELAY, the first connection established wins and the
+ * other attempts are dropped.
+ */
+
+class Connector
+{
+public:
+
+    using WatchCallback = std::function<bool (intptr_t socket, bool watch)>;
+
+    Connector();
+
+    ~Connector();
+
+    void start(const Resolver::AddressList &addresses, WatchCallback watch=nullptr);
+
+    int32_t poll(intptr_t &socket);
+
+    uint32_t timeout();
+
+    void wait(uint32_t ms);
+
+    void cancel();
+
+    bool active();
+
+protected:
+
+    bool attempt();
+
+    void close(intptr_t socket);
+
+protected:
+
+    Resolver::AddressList m_addresses;
+
+    size_t m_next;
+
+    std::vector<intptr_t> m_sockets;
+
+    std::chrono::steady_clock::time_point m_nextAttempt;
+
+    WatchCallback m_watch;
+};
+
+// ============================================================ //
+
+}
+
+#endif
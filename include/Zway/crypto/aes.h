@@ -55,6 +55,8 @@ public:
 
     void setCtr(MemoryBuffer$ ctr);
 
+    bool setCtr(MemoryBuffer$ ctr, uint64_t offset);
+
     bool encrypt(void* src, void* dst, uint32_t size, Callback callback=nullptr);
 
     bool encrypt(MemoryBuffer$ src, MemoryBuffer$ dst, uint32_t size, Callback callback=nullptr);
@@ -29,7 +29,13 @@
 
 #include "Zway/packet.h"
 #include "Zway/request.h"
+#include "Zway/requestregistry.h"
+#include "Zway/streamsender.h"
 #include "Zway/thread/safe.h"
+#include "Zway/transport.h"
+#include "Zway/util/timingwheel.h"
+
+#include <atomic>
 
 namespace Zway {
 
@@ -37,9 +43,7 @@ USING_SHARED_PTR(StreamReceiver)
 
 using StreamReceiverMap = std::map<uint32_t, StreamReceiver$>;
 
-using StreamSenderList = std::list<StreamSender$>;
-
-using RequestMap = std::map<uint32_t, Request$>;
+extern const uint32_t MAX_CONTROL_BATCH;
 
 // ============================================================ //
 
@@ -51,10 +55,14 @@ class Engine
 {
 public:
 
+    Engine();
+
     virtual ~Engine();
 
     void process();
 
+    uint32_t nextTimeout(uint32_t max);
+
     void finish();
 
     virtual bool addStreamSender(StreamSender$ sender);
@@ -67,31 +75,85 @@ public:
 
     bool postRequestFailure(uint32_t requestId, uint32_t code = 0, const std::string &msg = std::string());
 
+    bool postControl(const UBJ::Object &data);
+
+    bool flushControl();
+
     bool requestPending(Request::Type type, uint32_t id=0);
 
+    uint32_t numPendingRequests();
+
+    uint32_t numPendingRequests(Request::Type type);
+
     uint32_t numStreamSenders();
 
+    uint32_t streamEpoch();
+
+    void dropStreams();
+
+    int32_t sendPackets(Transport$ transport);
+
+    bool receivePacket(Transport$ transport, uint32_t ms);
+
+    void setPreferredPacketBodySize(uint32_t size);
+
+    uint32_t preferredPacketBodySize();
+
+    void setPacketBodySize(uint32_t size);
+
+    uint32_t packetBodySize(Packet::StreamType type = Packet::Resource);
+
+    void setCompression(bool compression);
+
+    bool compression();
+
+    void setBatching(bool batching);
+
+    bool batching();
+
 protected:
 
+    StreamReceiver$ streamReceiver(uint32_t streamId);
+
     virtual StreamReceiver$ createStreamReceiver(const Packet &pkt);
 
     bool processIncomingPacket(Packet &pkt);
 
+    void processRequestStream(const UBJ::Object &head);
+
     virtual bool processIncomingRequest(const UBJ::Object &request);
 
+    virtual void wake();
+
     virtual bool processRequestTimeout(Request$ request);
 
-    int32_t processStreamSenders(bool copyBody, std::function<bool (Packet$)> packetCallback);
+    int32_t processStreamSenders(std::function<bool (Packet$)> packetCallback);
 
-    void removeStreamSender(StreamSender$ sender);
+    int32_t processStreamSender(StreamSender$ sender, std::function<bool (Packet$)> &packetCallback);
 
 protected:
 
     ThreadSafe<StreamReceiverMap> m_streamReceivers;
 
-    ThreadSafe<StreamSenderList> m_streamSenders;
+    StreamSenderQueue m_requestSenders;
+
+    StreamSenderQueue m_resourceSenders;
+
+    RequestRegistry m_requests;
+
+    ThreadSafe<TimingWheel> m_timeouts;
+
+    ThreadSafe<uint32_t> m_preferredPacketBodySize;
+
+    ThreadSafe<uint32_t> m_packetBodySize;
+
+    ThreadSafe<bool> m_compression;
+
+    ThreadSafe<UBJ::Array> m_controlBatch;
+
+    ThreadSafe<bool> m_batching;
 
-    ThreadSafe<RequestMap> m_requests;
+    std::atomic<uint32_t> m_streamEpoch;
 };
 
 // ============================================================ //
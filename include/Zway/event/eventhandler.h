@@ -47,6 +47,8 @@ class ClientEvent
 {
 public:
 
+    ClientEvent() {}
+
     ClientEvent(Client$ client, Event$ event)
         : m_client(client),
           m_event(event) {}
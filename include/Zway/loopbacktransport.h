@@ -0,0 +1,128 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_LOOPBACK_TRANSPORT_H_
+#define ZWAY_CORE_LOOPBACK_TRANSPORT_H_
+
+#include "Zway/thread/safe.h"
+#include "Zway/transport.h"
+
+#include <condition_variable>
+#include <deque>
+
+namespace Zway {
+
+USING_SHARED_PTR(LoopbackTransport)
+
+extern const uint32_t LOOPBACK_BUFFER_SIZE;
+
+// ============================================================ //
+
+/**
+ * @brief The LoopbackTransport class
+ *
+ * In-memory transport, one end of a pair created by createPair().
+ * Packets sent on one end are received on the other. Each direction
+ * can be shaped to a bandwidth (bytes per second) and a one-way latency
+ * (ms), and holds at most bufferSize bytes in flight, beyond that send
+ * blocks like a full socket buffer would.
+ */
+
+class LoopbackTransport : public Transport
+{
+public:
+
+    using Pair = std::pair<LoopbackTransport$, LoopbackTransport$>;
+
+    static Pair createPair(
+            uint64_t bandwidth = 0,
+            uint32_t latency = 0,
+            uint32_t bufferSize = LOOPBACK_BUFFER_SIZE);
+
+    bool send(Packet$ pkt);
+
+    bool receive(Packet &pkt, uint32_t ms);
+
+    void close();
+
+    bool closed();
+
+    uint64_t packetsSent();
+
+    uint64_t bytesSent();
+
+protected:
+
+    struct Link
+    {
+        struct Entry
+        {
+            uint64_t deliverAt;
+
+            Packet$ packet;
+        };
+
+        std::mutex mutex;
+
+        std::condition_variable condition;
+
+        std::deque<Entry> queue;
+
+        uint64_t bandwidth;
+
+        uint32_t latency;
+
+        uint32_t bufferSize;
+
+        uint32_t bytesQueued;
+
+        uint64_t busyUntil;
+
+        uint64_t packetsSent;
+
+        uint64_t bytesSent;
+
+        bool closed;
+    };
+
+    using Link$ = std::shared_ptr<Link>;
+
+    static uint64_t now();
+
+    LoopbackTransport(Link$ in, Link$ out);
+
+protected:
+
+    Link$ m_in;
+
+    Link$ m_out;
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_MAPPED_FILE_BUFFER_H_
+#define ZWAY_CORE_MAPPED_FILE_BUFFER_H_
+
+#include "Zway/buffer.h"
+
+#include <string>
+
+namespace Zway {
+
+USING_SHARED_PTR(MappedFileBuffer)
+
+// ============================================================ //
+
+/**
+ * @brief The MappedFileBuffer class
+ *
+ * Read-only buffer backed by a private mapping of a file. Pages are
+ * loaded by the kernel as they are touched, so large files cost no
+ * heap memory and can be served in chunks on demand.
+ */
+
+class MappedFileBuffer : public Buffer
+{
+public:
+
+    static MappedFileBuffer$ create(const std::string &path);
+
+    virtual ~MappedFileBuffer();
+
+    virtual bool read(uint8_t* data, uint32_t size, uint32_t offset, uint32_t *bytesRead);
+
+    virtual bool write(const uint8_t *data, uint32_t size, uint32_t offset, uint32_t *bytesWritten);
+
+    bool available(uint32_t offset, uint32_t size);
+
+    void willNeed(uint32_t offset, uint32_t size);
+
+    void dontNeed(uint32_t offset, uint32_t size);
+
+    const uint8_t* data();
+
+protected:
+
+    MappedFileBuffer();
+
+    bool init(const std::string &path);
+
+    void release();
+
+    void advise(uint32_t offset, uint32_t size, int advice);
+
+protected:
+
+    uint8_t* m_data = nullptr;
+
+    int32_t m_fd = -1;
+};
+
+// ============================================================ //
+
+}
+
+#endif
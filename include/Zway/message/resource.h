@@ -28,11 +28,17 @@
 #define RESOURCE_H_
 
 #include "Zway/ubj/value.h"
+#include "Zway/packet.h"
 
+#include <atomic>
 #include <fstream>
+#include <future>
+#include <mutex>
 
 namespace Zway {
 
+USING_SHARED_PTR(Buffer)
+USING_SHARED_PTR(MappedFileBuffer)
 USING_SHARED_PTR(Store)
 USING_SHARED_PTR(Resource)
 
@@ -100,9 +106,9 @@ public:
 
     uint32_t size();
 
-    uint32_t parts();
+    uint32_t parts(uint32_t bodySize = MAX_PACKET_BODY);
 
-    std::string hash();
+    virtual std::string hash();
 
 protected:
 
@@ -110,9 +116,7 @@ protected:
 
 protected:
 
-    uint32_t m_parts;
-
-    MemoryBuffer$ m_data;
+    Buffer$ m_data;
 
 };
 
@@ -128,12 +132,30 @@ public:
 
     static Resource$ create(const std::string& path, const std::string &name = std::string());
 
+    ~FileSystemResource();
+
+    bool read(MemoryBuffer$ buf, uint32_t size, uint32_t offset);
+
+    std::string hash();
+
 protected:
 
     FileSystemResource(const std::string& path, const std::string &name);
 
     bool init(const std::string &path);
 
+    static std::string computeHash(MappedFileBuffer$ file, const std::atomic<bool> &canceled);
+
+protected:
+
+    MappedFileBuffer$ m_file;
+
+    std::shared_future<std::string> m_hash;
+
+    std::shared_ptr<std::atomic<bool>> m_hashCanceled;
+
+    std::once_flag m_hashOnce;
+
 };
 
 // ============================================================ //
@@ -29,12 +29,17 @@
 
 #include "Zway/bufferreceiver.h"
 #include "Zway/crypto/aes.h"
+#include "Zway/ubj/store/blob.h"
 
 namespace Zway {
 
 USING_SHARED_PTR(Resource)
 USING_SHARED_PTR(ResourceReceiver)
 
+using ResourceCheckpointCallback = std::function<void (ResourceReceiver$, uint32_t)>;
+
+extern const uint32_t RESOURCE_CHECKPOINT_BYTES;
+
 // ============================================================ //
 
 /**
@@ -51,18 +56,42 @@ public:
             MemoryBuffer$ salt,
             BufferReceiverCallback callback);
 
+    static ResourceReceiver$ create(
+            const Packet &pkt,
+            MemoryBuffer$ key,
+            MemoryBuffer$ salt,
+            UBJ::Store::Blob$ blob,
+            BufferReceiverCallback callback,
+            uint32_t bodySize = 0);
+
+    void setCheckpointCallback(ResourceCheckpointCallback callback);
+
+    UBJ::Store::Blob$ blob();
+
+    uint32_t bodySize();
+
 protected:
 
     ResourceReceiver(BufferReceiverCallback callback);
 
-    bool init(const Packet &pkt, MemoryBuffer$ key, MemoryBuffer$ salt);
+    bool init(const Packet &pkt, MemoryBuffer$ key, MemoryBuffer$ salt, UBJ::Store::Blob$ blob = nullptr, uint32_t bodySize = 0);
+
+    bool checkpoint(uint32_t part);
 
     bool processPacket(Packet &pkt);
 
+    void invokeCallback();
+
 protected:
 
     Crypto::AES m_aes;
 
+    UBJ::Store::Blob$ m_blob;
+
+    ResourceCheckpointCallback m_checkpointCallback;
+
+    uint32_t m_checkpointBytes;
+
 };
 
 // ============================================================ //
@@ -35,6 +35,8 @@ namespace Zway {
 USING_SHARED_PTR(Resource)
 USING_SHARED_PTR(ResourceSender)
 
+extern const uint32_t RESOURCE_SPOOL_CHUNK;
+
 // ============================================================ //
 
 /**
@@ -49,13 +51,19 @@ public:
             Resource$ res,
             MemoryBuffer$ key,
             MemoryBuffer$ salt,
-            StreamSenderCallback callback = nullptr);
+            StreamSenderCallback callback = nullptr,
+            uint32_t bodySize = MAX_PACKET_BODY,
+            uint32_t startPart = 1);
+
+    bool enableSpooling();
 
 protected:
 
     ResourceSender(Resource$ res, StreamSenderCallback callback);
 
-    bool init(MemoryBuffer$ key, MemoryBuffer$ salt);
+    bool init(MemoryBuffer$ key, MemoryBuffer$ salt, uint32_t bodySize, uint32_t startPart);
+
+    bool leasesBody();
 
     bool preparePacket(Packet$ &pkt, uint32_t bytesToSend, uint32_t bytesSent);
 
@@ -63,12 +71,20 @@ protected:
 
     void invokeCallback();
 
+    bool spool(uint32_t size);
+
 protected:
 
     Resource$ m_res;
 
     Crypto::AES m_aes;
 
+    SpoolFileBuffer$ m_spool;
+
+    MemoryBuffer$ m_spoolBuffer;
+
+    uint32_t m_spooled;
+
 };
 
 // ============================================================ //
@@ -33,9 +33,12 @@ namespace Zway {
 
 USING_SHARED_PTR(Packet)
 USING_SHARED_PTR(MemoryBuffer)
+USING_SHARED_PTR(SpoolFileBuffer)
 
 extern const uint32_t MAX_PACKET_HEAD;
 extern const uint32_t MAX_PACKET_BODY;
+extern const uint32_t MIN_PACKET_BODY;
+extern const uint32_t MAX_JUMBO_PACKET_BODY;
 
 // ============================================================ //
 
@@ -56,6 +59,11 @@ public:
         Resource
     };
 
+    enum StreamFlags {
+
+        Compressed = 0x1
+    };
+
     struct Head
     {
         uint32_t id;
@@ -73,6 +81,8 @@ public:
 
     static Packet$ create(uint32_t id = 0);
 
+    static uint32_t numParts(uint32_t size, uint32_t bodySize = MAX_PACKET_BODY);
+
     Packet(uint32_t id = 0);
 
     Head &head();
@@ -83,6 +93,8 @@ public:
 
     StreamType streamType() const;
 
+    uint32_t streamFlags() const;
+
     uint32_t part() const;
 
     uint32_t parts() const;
@@ -93,25 +105,37 @@ public:
 
     MemoryBuffer$ body();
 
+    SpoolFileBuffer$ bodyFile();
+
+    uint32_t bodyOffset() const;
+
     void setId(uint32_t id);
 
     void setStreamId(uint32_t id);
 
     void setStreamType(StreamType type);
 
+    void setStreamFlags(uint32_t flags);
+
     void setPart(uint32_t part);
 
     void setParts(uint32_t parts);
 
     void setBodySize(uint32_t size);
 
-    void setBody(MemoryBuffer$ body, uint32_t size = 0);
+    void setBody(MemoryBuffer$ body, uint32_t size = 0, uint32_t offset = 0);
+
+    void setBodyFile(SpoolFileBuffer$ file, uint32_t size, uint32_t offset);
 
 protected:
 
     Head m_head;
 
     MemoryBuffer$ m_body;
+
+    SpoolFileBuffer$ m_bodyFile;
+
+    uint32_t m_bodyOffset;
 };
 
 // ============================================================ //
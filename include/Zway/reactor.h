@@ -0,0 +1,125 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_REACTOR_H_
+#define ZWAY_CORE_REACTOR_H_
+
+#include "Zway/types.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace Zway {
+
+USING_SHARED_PTR(Reactor)
+
+extern const uint32_t REACTOR_INFINITE;
+
+// ============================================================ //
+
+/**
+ * @brief The Reactor class
+ *
+ * Readiness events of a non-blocking socket, shared by the threads doing
+ * I/O on it. On Linux the socket is registered edge-triggered with epoll
+ * and an eventfd interrupts the wait, other platforms poll the events
+ * the waiting threads are interested in.
+ *
+ * Readiness is kept as state: an I/O attempt clears the state it depends
+ * on first, if it then fails with EAGAIN, wait() returns as soon as a new
+ * event arrived, also one that arrived in between. Only one thread polls
+ * at a time, the others wait for it to publish the events.
+ */
+
+class Reactor
+{
+public:
+
+    enum Events
+    {
+        Readable = 0x1,
+
+        Writable = 0x2,
+
+        Error    = 0x4,
+
+        Woken    = 0x8
+    };
+
+    Reactor();
+
+    ~Reactor();
+
+    bool attach(intptr_t socket);
+
+    void detach();
+
+    bool attached();
+
+    void set(uint32_t events);
+
+    void clear(uint32_t events);
+
+    int32_t wait(uint32_t events, uint32_t ms = REACTOR_INFINITE);
+
+    void wake();
+
+protected:
+
+    bool open();
+
+    void close();
+
+    void interrupt();
+
+    uint32_t poll(intptr_t socket, uint32_t interest, int32_t ms);
+
+protected:
+
+    intptr_t m_socket;
+
+    int32_t m_pollFd;
+
+    int32_t m_wakeFds[2];
+
+    uint32_t m_ready;
+
+    uint32_t m_interest[2];
+
+    uint64_t m_wakeups;
+
+    bool m_polling;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_condition;
+};
+
+// ============================================================ //
+
+}
+
+#endif
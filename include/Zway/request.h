@@ -98,7 +98,7 @@ public:
 
     virtual ~Request();
 
-    StreamSender$ start();
+    StreamSender$ start(bool compress = false);
 
     virtual bool processResponse(const UBJ::Object &response);
 
@@ -106,7 +106,11 @@ public:
 
     void setStatus(Status status);
 
-    bool checkTimeout(uint64_t time);
+    void setTimeout(uint32_t timeout);
+
+    uint32_t timeout();
+
+    uint64_t deadline();
 
     uint32_t id();
 
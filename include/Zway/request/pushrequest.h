@@ -29,6 +29,7 @@
 
 #include "Zway/request.h"
 #include "Zway/message/message.h"
+#include "Zway/thread/safe.h"
 
 namespace Zway {
 
@@ -65,7 +66,13 @@ protected:
     bool updateMessage(Message::Status status, UBJ::Object *message = nullptr);
 
 
-    static void pushResources(PushRequest$ request, const UBJ::Array &resourceIds, const std::function<void (PushRequest$)> &callback, uint32_t index=0);
+    static void pushResources(PushRequest$ request, const UBJ::Array &resources, const std::function<void (PushRequest$)> &callback);
+
+    void pushNext();
+
+    bool pushResource(const UBJ::Value &entry);
+
+    void resourceFinished();
 
 
 protected:
@@ -77,6 +84,26 @@ protected:
     MemoryBuffer$ m_key;
 
     MemoryBuffer$ m_salt;
+
+    uint32_t m_bodySize;
+
+    std::mutex m_pushMutex;
+
+    UBJ::Array m_pushResources;
+
+    std::function<void (PushRequest$)> m_pushCallback;
+
+    uint32_t m_pushWindow;
+
+    uint32_t m_resourcesStarted;
+
+    uint32_t m_resourcesInFlight;
+
+    uint32_t m_resourcesFinished;
+
+    uint32_t m_pushEpoch;
+
+    friend class Client;
 };
 
 // ============================================================ //
@@ -0,0 +1,102 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_REQUEST_REGISTRY_H_
+#define ZWAY_CORE_REQUEST_REGISTRY_H_
+
+#include "Zway/request.h"
+#include "Zway/thread/safe.h"
+
+#include <array>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+ * @brief The RequestRegistry class
+ *
+ * Pending requests, split into shards by id. Each shard has its own
+ * lock, its id map and an index of the ids per request type, so lookup,
+ * insert and erase only lock the shard of the given id.
+ */
+
+class RequestRegistry
+{
+public:
+
+    static const uint32_t NUM_SHARDS = 16;
+
+    RequestRegistry();
+
+    bool insert(Request$ request);
+
+    Request$ find(uint32_t id);
+
+    Request$ take(uint32_t id);
+
+    bool erase(uint32_t id);
+
+    bool pending(Request::Type type, uint32_t id=0);
+
+    uint32_t count();
+
+    uint32_t count(Request::Type type);
+
+    void clear();
+
+protected:
+
+    using TypeIndex = std::unordered_map<uint32_t, std::unordered_set<uint32_t>>;
+
+    struct Shard
+    {
+        std::mutex mutex;
+
+        std::unordered_map<uint32_t, Request$> requests;
+
+        TypeIndex types;
+    };
+
+    Shard &shard(uint32_t id);
+
+    void remove(Shard &shard, Request$ request);
+
+protected:
+
+    std::array<Shard, NUM_SHARDS> m_shards;
+
+    std::atomic<uint32_t> m_count;
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_RESOLVER_H_
+#define ZWAY_CORE_RESOLVER_H_
+
+#include "Zway/thread/handler.h"
+#include "Zway/types.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Zway {
+
+USING_SHARED_PTR(Resolver)
+
+extern const uint32_t RESOLVER_CACHE_TTL;
+
+// ============================================================ //
+
+/**
+ * @brief The ResolverQuery struct
+ */
+
+struct ResolverQuery
+{
+    std::string host;
+
+    uint16_t port = 0;
+
+    std::function<void (const std::vector<std::string> &)> callback;
+};
+
+/**
+ * @brief The Resolver class
+ *
+ * Resolves host names with getaddrinfo on a thread of its own and
+ * caches the addresses for RESOLVER_CACHE_TTL. Addresses are raw
+ * sockaddr structures, IPv6 and IPv4 interleaved as happy eyeballs
+ * tries them. Subclasses may override lookup(), e.g. to stub it.
+ */
+
+class Resolver : public Handler<ResolverQuery>
+{
+public:
+
+    using AddressList = std::vector<std::string>;
+
+    using Callback = std::function<void (const AddressList &addresses)>;
+
+    static Resolver$ instance();
+
+    static Resolver$ create();
+
+    virtual ~Resolver();
+
+    void resolve(const std::string &host, uint16_t port, Callback callback);
+
+    void invalidate(const std::string &host, uint16_t port);
+
+    void setCacheTtl(uint32_t ms);
+
+    static AddressList interleave(const AddressList &addresses);
+
+protected:
+
+    Resolver();
+
+    void process(ResolverQuery &query);
+
+    virtual AddressList lookup(const std::string &host, uint16_t port);
+
+    static std::string key(const std::string &host, uint16_t port);
+
+protected:
+
+    struct Entry
+    {
+        AddressList addresses;
+
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    ThreadSafe<std::map<std::string, Entry>> m_cache;
+
+    std::atomic<uint32_t> m_cacheTtl;
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -99,6 +99,11 @@ public:
     bool setConfig(const UBJ::Object &config = UBJ::Object());
 
 
+    MemoryBuffer$ tlsSession(const std::string &peer);
+
+    bool setTlsSession(const std::string &peer, MemoryBuffer$ session);
+
+
     uint64_t createVfsNode(VfsNodeType type, const std::string &name, uint64_t parent=0, const UBJ::Object &data={});
 
     MemoryBuffer$ getVfsNodeData(uint64_t id);
@@ -58,10 +58,14 @@ public:
 
     virtual bool process(Packet &pkt);
 
+    virtual MemoryBuffer$ packetBuffer(const Packet &pkt, uint32_t &offset);
+
     uint32_t id();
 
     Packet::StreamType type();
 
+    uint32_t flags();
+
     Status status();
 
     uint32_t parts();
@@ -82,6 +86,8 @@ protected:
 
     Packet::StreamType m_type;
 
+    uint32_t m_flags;
+
     Status m_status;
 
     uint32_t m_part;
@@ -28,6 +28,7 @@
 #define ZWAY_CORE_STREAM_SENDER_H_
 
 #include "Zway/packet.h"
+#include "Zway/thread/queue.h"
 
 namespace Zway {
 
@@ -41,7 +42,7 @@ using StreamSenderCallback = std::function<void (StreamSender$)>;
  * @brief The StreamSender class
  */
 
-class StreamSender : public std::enable_shared_from_this<StreamSender>
+class StreamSender : public std::enable_shared_from_this<StreamSender>, public MpscNode
 {
 public:
 
@@ -64,12 +65,24 @@ public:
 
     Packet::StreamType type();
 
+    uint32_t flags();
+
     Status status();
 
     uint32_t part();
 
     uint32_t parts();
 
+    uint32_t bodySize();
+
+    bool setBodySize(uint32_t size);
+
+    bool setStartPart(uint32_t part);
+
+    uint32_t quantum();
+
+    void setQuantum(uint32_t quantum);
+
 protected:
 
     StreamSender(
@@ -80,18 +93,24 @@ protected:
 
     bool init(uint32_t streamSize = 0);
 
+    virtual bool leasesBody();
+
     virtual bool preparePacket(Packet$ &pkt, uint32_t bytesToSend, uint32_t bytesSent);
 
     virtual bool processPacket(Packet$ &pkt);
 
     virtual void invokeCallback();
 
+    void fail();
+
 protected:
 
     uint32_t m_id;
 
     Packet::StreamType m_type;
 
+    uint32_t m_flags;
+
     Status m_status;
 
     StreamSenderCallback m_callback;
@@ -102,7 +121,54 @@ protected:
 
     uint32_t m_parts;
 
+    uint32_t m_bodySize;
+
+    uint32_t m_quantum;
+
+    int64_t m_deficit;
+
+    uint32_t m_epoch;
+
+    StreamSender$ m_queueRef;
+
     MemoryBuffer$ m_body;
+
+    friend class Engine;
+
+    friend class StreamSenderQueue;
+};
+
+/**
+ * @brief The StreamSenderQueue class
+ *
+ * FIFO of stream senders, linked through the senders themselves
+ * so that queueing doesn't allocate. Senders may be pushed from any
+ * thread without locking, pop and clear belong to the thread that
+ * processes the senders. A queued sender holds a reference to itself
+ * until it is popped.
+ */
+
+class StreamSenderQueue
+{
+public:
+
+    StreamSenderQueue();
+
+    ~StreamSenderQueue();
+
+    void push(StreamSender$ sender);
+
+    StreamSender$ pop();
+
+    void clear();
+
+    bool empty();
+
+    uint32_t size();
+
+protected:
+
+    MpscNodeQueue<StreamSender> m_queue;
 };
 
 // ============================================================ //
@@ -0,0 +1,132 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_EXECUTOR_H_
+#define ZWAY_EXECUTOR_H_
+
+#include "Zway/types.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Zway {
+
+USING_SHARED_PTR(Executor)
+
+extern const uint32_t MAX_EXECUTOR_THREADS;
+
+// ============================================================ //
+
+/**
+ * @brief The Executor class
+ *
+ * Pool of worker threads running tasks posted with a key. Tasks with
+ * the same key run one after another in the order they were posted,
+ * tasks with different keys run in parallel. Keys with pending tasks
+ * take turns, one task each, so a busy key can't starve the others.
+ * Threads are started as tasks come up, up to the given number.
+ * Tasks may be posted for a group, to cancel them all at once.
+ */
+
+class Executor
+{
+public:
+
+    using Task = std::function<void ()>;
+
+    static uint32_t defaultThreads();
+
+    static Executor$ instance();
+
+    Executor();
+
+    ~Executor();
+
+    bool start(uint32_t numThreads = 0);
+
+    void stop();
+
+    bool post(uint64_t key, Task task, uint64_t group = 0);
+
+    void cancel(uint64_t group);
+
+    bool running();
+
+    uint32_t numThreads();
+
+    uint32_t numPending();
+
+protected:
+
+    void run();
+
+protected:
+
+    struct Item
+    {
+        Task task;
+
+        uint64_t group;
+    };
+
+    struct Lane
+    {
+        std::deque<Item> tasks;
+    };
+
+    std::unordered_map<uint64_t, Lane> m_lanes;
+
+    std::deque<uint64_t> m_ready;
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_condition;
+
+    std::condition_variable m_finished;
+
+    std::vector<std::pair<std::thread::id, uint64_t>> m_active;
+
+    uint32_t m_numPending;
+
+    uint32_t m_maxThreads;
+
+    uint32_t m_numIdle;
+
+    bool m_running;
+};
+
+// ============================================================ //
+
+}
+
+#endif
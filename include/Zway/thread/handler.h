@@ -27,8 +27,10 @@
 #ifndef ZWAY_HANDLER_H_
 #define ZWAY_HANDLER_H_
 
+#include "Zway/thread/queue.h"
 #include "Zway/thread/thread.h"
 
+#include <atomic>
 #include <list>
 
 namespace Zway {
@@ -37,6 +39,16 @@ namespace Zway {
 
 /**
  * @brief The Handler class
+ *
+ * Elements are posted through a lock-free queue. If it is full, posting
+ * threads wait for the handler to catch up, except for the handler
+ * thread itself, its elements go to an overflow list behind the queue.
+ *
+ * The handler thread works off up to a batch of elements between checks
+ * of its state. An idle handler announces that it is waiting before it
+ * tests for work under the wait mutex, posts and notifies only take the
+ * mutex when it waits, and a post or notify racing the test is seen by
+ * either side, so none gets lost.
  */
 
 template <typename T>
@@ -44,38 +56,85 @@ class Handler : public Thread
 {
 public:
 
-    Handler()
-        : m_busy(false)
+    static const uint32_t DEFAULT_QUEUE_CAPACITY = 4096;
+
+    static const uint32_t DEFAULT_BATCH_SIZE = 64;
+
+    Handler(uint32_t capacity = DEFAULT_QUEUE_CAPACITY, uint32_t batchSize = DEFAULT_BATCH_SIZE)
+        : m_queue(capacity),
+          m_overflowSize(0),
+          m_batchSize(batchSize ? batchSize : 1),
+          m_clear(false),
+          m_waiting(false),
+          m_signaled(false)
     {
 
     }
 
+    /**
+     * @brief notify
+     *
+     * Wakes the handler to look for work, also if there are no queued
+     * elements, e.g. for getElements().
+     */
+
     void notify()
     {
-        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_signaled = true;
 
-        m_waitCondition.notify_one();
+        wake();
     }
 
     void post(const T &element)
     {
-        {
-            MutexLocker lock(m_queue);
+        T copy(element);
+
+        post(std::move(copy));
+    }
+
+    void post(T &&element)
+    {
+        if (std::this_thread::get_id() == threadId()) {
+
+            // keep the order of elements the handler posts to itself
+
+            if (!m_overflow.empty() || !m_queue.push(std::move(element))) {
+
+                m_overflow.push_back(std::move(element));
 
-            m_queue->push_back(element);
+                m_overflowSize = m_overflow.size();
+            }
+
+            return;
         }
 
-        if (!busy()) {
+        while (!m_queue.push(std::move(element))) {
+
+            wake();
 
-            notify();
+            std::this_thread::yield();
         }
+
+        wake();
     }
 
+    /**
+     * @brief clear
+     *
+     * Drops the queued elements, on the handler thread before it takes
+     * the next one.
+     */
+
     void clear()
     {
-        MutexLocker lock(m_queue);
+        m_clear = true;
 
-        m_queue->clear();
+        notify();
+    }
+
+    uint32_t numElements()
+    {
+        return m_queue.size() + m_overflowSize;
     }
 
     void suspend()
@@ -94,9 +153,7 @@ public:
 
     bool busy()
     {
-        MutexLocker lock(m_busy);
-
-        return m_busy;
+        return !m_waiting;
     }
 
 protected:
@@ -108,23 +165,75 @@ protected:
         return false;
     }
 
+    /**
+     * @brief cleared
+     *
+     * Called on the handler thread once clear() dropped the elements.
+     */
+
+    virtual void cleared()
+    {
+
+    }
+
+    /**
+     * @brief wake
+     *
+     * Pairs with wait(), the fence orders the caller's queue push or
+     * signal before its test of m_waiting.
+     */
+
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_waiting.load(std::memory_order_relaxed)) {
+
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+
+            m_waitCondition.notify_one();
+        }
+    }
+
     void wait()
     {
+        m_waiting = true;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
         {
-            MutexLocker lock(m_busy);
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+
+            m_waitCondition.wait(lock, [this] () {
 
-            m_busy = false;
+                return m_signaled.load() || !m_queue.empty();
+            });
         }
 
-        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_waiting = false;
 
-        m_waitCondition.wait(lock);
+        m_signaled = false;
+    }
 
-        {
-            MutexLocker lock(m_busy);
+    bool next(T &element)
+    {
+        if (m_queue.pop(element)) {
+
+            return true;
+        }
 
-            m_busy = true;
+        if (!m_overflow.empty()) {
+
+            element = std::move(m_overflow.front());
+
+            m_overflow.pop_front();
+
+            m_overflowSize = m_overflow.size();
+
+            return true;
         }
+
+        return false;
     }
 
     void run()
@@ -143,40 +252,52 @@ protected:
                 continue;
             }
 
-            T *element = nullptr;
+            if (m_clear.exchange(false)) {
+
+                m_queue.clear();
 
-            {
-                MutexLocker lock(m_queue);
+                m_overflow.clear();
 
-                if (!m_queue->empty()) {
+                m_overflowSize = 0;
 
-                    element = &m_queue->front();
-                }
+                cleared();
             }
 
-            if (element) {
+            // drain a batch before looking at the state again
 
-                process(*element);
+            uint32_t n = 0;
 
-                MutexLocker lock(m_queue);
+            T element;
 
-                m_queue->pop_front();
+            while (n < m_batchSize && next(element)) {
+
+                process(element);
+
+                ++n;
             }
-            else {
 
-                if (!getElements()) {
+            if (!n && !getElements()) {
 
-                    wait();
-                }
+                wait();
             }
         }
     }
 
 protected:
 
-    ThreadSafe<std::list<T>> m_queue;
+    MpscQueue<T> m_queue;
+
+    std::list<T> m_overflow;
+
+    std::atomic<uint32_t> m_overflowSize;
+
+    const uint32_t m_batchSize;
+
+    std::atomic<bool> m_clear;
+
+    std::atomic<bool> m_waiting;
 
-    ThreadSafe<bool> m_busy;
+    std::atomic<bool> m_signaled;
 
     std::mutex m_waitMutex;
 
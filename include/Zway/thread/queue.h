@@ -0,0 +1,396 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_QUEUE_H_
+#define ZWAY_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace Zway {
+
+// members written by different threads are padded apart by a cache
+// line, alignas isn't honoured by plain new before C++17
+
+const size_t QUEUE_CACHE_LINE = 64;
+
+// ============================================================ //
+
+/**
+ * @brief The MpscQueue class
+ *
+ * Bounded lock-free queue for many producers and a single consumer.
+ * Elements live in a preallocated ring, every cell carries a sequence
+ * number that tells producers and the consumer whether it is free or
+ * filled, so neither side takes a lock or allocates. Elements are moved
+ * in and out, a failed push leaves the element untouched.
+ */
+
+template <typename T>
+class MpscQueue
+{
+public:
+
+    explicit MpscQueue(uint32_t capacity)
+        : m_enqueuePos(0),
+          m_dequeuePos(0)
+    {
+        size_t size = 2;
+
+        while (size < capacity) {
+
+            size <<= 1;
+        }
+
+        m_mask = size - 1;
+
+        m_cells.reset(new Cell[size]);
+
+        for (size_t i=0; i<size; ++i) {
+
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief push
+     * @param element
+     * @return false if the queue is full
+     *
+     * May be called from any thread.
+     */
+
+    bool push(T &&element)
+    {
+        Cell *cell;
+
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+
+            cell = &m_cells[pos & m_mask];
+
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0) {
+
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+
+                    break;
+                }
+            }
+            else
+            if (diff < 0) {
+
+                return false;
+            }
+            else {
+
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(element);
+
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool push(const T &element)
+    {
+        T copy(element);
+
+        return push(std::move(copy));
+    }
+
+    /**
+     * @brief pop
+     * @param element
+     * @return false if the queue is empty
+     *
+     * Must only be called by the consumer thread.
+     */
+
+    bool pop(T &element)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+
+        Cell *cell = &m_cells[pos & m_mask];
+
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+
+            return false;
+        }
+
+        element = std::move(cell->value);
+
+        // don't keep references to the element alive in the ring
+
+        cell->value = T();
+
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * @brief clear
+     *
+     * Must only be called by the consumer thread.
+     */
+
+    void clear()
+    {
+        T element;
+
+        while (pop(element)) {
+
+        }
+    }
+
+    /**
+     * @brief size
+     * @return
+     *
+     * Approximate while producers or the consumer are active.
+     */
+
+    uint32_t size() const
+    {
+        size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    uint32_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+protected:
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+
+    size_t m_mask;
+
+    // producers and the consumer write different cache lines
+
+    char m_pad0[QUEUE_CACHE_LINE];
+
+    std::atomic<size_t> m_enqueuePos;
+
+    char m_pad1[QUEUE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+
+    std::atomic<size_t> m_dequeuePos;
+
+    char m_pad2[QUEUE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+// ============================================================ //
+
+/**
+ * @brief The MpscNode class
+ *
+ * Link for elements of a MpscNodeQueue.
+ */
+
+class MpscNode
+{
+public:
+
+    MpscNode()
+        : m_mpscNext(nullptr)
+    {
+    }
+
+    std::atomic<MpscNode*> m_mpscNext;
+};
+
+/**
+ * @brief The MpscNodeQueue class
+ *
+ * Unbounded intrusive lock-free queue for many producers and a single
+ * consumer. Elements derive from MpscNode and are linked through it,
+ * so queueing doesn't allocate. The queue doesn't own its elements.
+ * While a producer is in the middle of a push, pop may report the
+ * queue as empty, the element shows up once the push returned.
+ */
+
+template <typename T>
+class MpscNodeQueue
+{
+public:
+
+    MpscNodeQueue()
+        : m_head(&m_stub),
+          m_tail(&m_stub),
+          m_size(0)
+    {
+    }
+
+    MpscNodeQueue(const MpscNodeQueue&) = delete;
+
+    MpscNodeQueue& operator=(const MpscNodeQueue&) = delete;
+
+    /**
+     * @brief push
+     * @param node
+     *
+     * May be called from any thread.
+     */
+
+    void push(T *node)
+    {
+        m_size.fetch_add(1, std::memory_order_relaxed);
+
+        link(node);
+    }
+
+    /**
+     * @brief pop
+     * @return the oldest element or nullptr
+     *
+     * Must only be called by the consumer thread.
+     */
+
+    T *pop()
+    {
+        MpscNode *tail = m_tail;
+
+        MpscNode *next = tail->m_mpscNext.load(std::memory_order_acquire);
+
+        if (tail == &m_stub) {
+
+            if (!next) {
+
+                return nullptr;
+            }
+
+            m_tail = next;
+
+            tail = next;
+
+            next = next->m_mpscNext.load(std::memory_order_acquire);
+        }
+
+        if (!next) {
+
+            // tail is the last element, put the stub behind it so
+            // that it can be taken off without touching the head
+
+            if (tail != m_head.load(std::memory_order_acquire)) {
+
+                return nullptr;
+            }
+
+            link(&m_stub);
+
+            next = tail->m_mpscNext.load(std::memory_order_acquire);
+
+            if (!next) {
+
+                return nullptr;
+            }
+        }
+
+        m_tail = next;
+
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+
+        return static_cast<T*>(tail);
+    }
+
+    uint32_t size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+protected:
+
+    void link(MpscNode *node)
+    {
+        node->m_mpscNext.store(nullptr, std::memory_order_relaxed);
+
+        MpscNode *prev = m_head.exchange(node, std::memory_order_acq_rel);
+
+        prev->m_mpscNext.store(node, std::memory_order_release);
+    }
+
+protected:
+
+    MpscNode m_stub;
+
+    char m_pad0[QUEUE_CACHE_LINE];
+
+    std::atomic<MpscNode*> m_head;
+
+    char m_pad1[QUEUE_CACHE_LINE - sizeof(std::atomic<MpscNode*>)];
+
+    MpscNode *m_tail;
+
+    std::atomic<uint32_t> m_size;
+
+    char m_pad2[QUEUE_CACHE_LINE];
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "Zway/thread/safe.h"
 
+#include <atomic>
 #include <thread>
 #include <condition_variable>
 
@@ -84,11 +85,11 @@ protected:
 
     std::thread m_thread;
 
-    ThreadSafe<bool> m_running;
+    std::atomic<bool> m_running;
 
-    ThreadSafe<bool> m_suspended;
+    std::atomic<bool> m_suspended;
 
-    ThreadSafe<bool> m_canceled;
+    std::atomic<bool> m_canceled;
 
     std::mutex m_waitResumeMutex;
 
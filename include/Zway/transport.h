@@ -0,0 +1,65 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_CORE_TRANSPORT_H_
+#define ZWAY_CORE_TRANSPORT_H_
+
+#include "Zway/packet.h"
+
+namespace Zway {
+
+USING_SHARED_PTR(Transport)
+
+// ============================================================ //
+
+/**
+ * @brief The Transport class
+ *
+ * Carries packets between two engines. Engine::sendPackets() hands the
+ * packets of its stream senders to a transport and receivePacket()
+ * feeds packets from it into the stream receivers.
+ */
+
+class Transport
+{
+public:
+
+    virtual ~Transport() {}
+
+    virtual bool send(Packet$ pkt) = 0;
+
+    virtual bool receive(Packet &pkt, uint32_t ms) = 0;
+
+    virtual void close() = 0;
+
+    virtual bool closed() = 0;
+};
+
+// ============================================================ //
+
+}
+
+#endif
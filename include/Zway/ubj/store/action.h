@@ -30,6 +30,7 @@
 #include "Zway/ubj/value.h"
 #include "Zway/thread/safe.h"
 
+#include <atomic>
 #include <condition_variable>
 
 #include <sqlite3.h>
@@ -114,7 +115,7 @@ protected:
 
     std::condition_variable m_waitCondition;
 
-    ThreadSafe<bool> m_done;
+    std::atomic<bool> m_done;
 
     friend class Cursor;
 
@@ -58,6 +58,10 @@ public:
 
     bool close();
 
+    bool reopen();
+
+    bool seek(uint32_t offset);
+
     uint64_t id();
 
     Crypto::AES &aes();
@@ -68,8 +72,12 @@ protected:
 
     Store$ m_store;
 
+    std::string m_table;
+
     uint64_t m_id;
 
+    bool m_readOnly;
+
     bool m_mode;
 
     void *m_blob;
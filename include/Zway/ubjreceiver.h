@@ -59,6 +59,8 @@ protected:
 
     void invokeCallback();
 
+    static MemoryBuffer$ inflate(const uint8_t *data, uint32_t size);
+
 protected:
 
     Zway::UBJ::Value m_value;
@@ -34,6 +34,8 @@ namespace Zway {
 
 USING_SHARED_PTR(UbjSender)
 
+extern const uint32_t UBJ_COMPRESSION_THRESHOLD;
+
 // ============================================================ //
 
 /**
@@ -48,7 +50,8 @@ public:
             uint32_t id,
             Packet::StreamType type,
             const UBJ::Value &value,
-            StreamSenderCallback callback = nullptr);
+            StreamSenderCallback callback = nullptr,
+            bool compress = false);
 
 protected:
 
@@ -58,7 +61,9 @@ protected:
             const UBJ::Value &value,
             StreamSenderCallback callback);
 
-    bool init(const UBJ::Value &value);
+    bool init(const UBJ::Value &value, bool compress);
+
+    static MemoryBuffer$ deflate(MemoryBuffer$ buffer);
 
 };
 
@@ -0,0 +1,105 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef ZWAY_TIMING_WHEEL_H_
+#define ZWAY_TIMING_WHEEL_H_
+
+#include "Zway/types.h"
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+ * @brief The TimingWheel class
+ *
+ * Hierarchical timing wheel keyed by id. Deadlines are milliseconds on
+ * the monotonic clock, timers are inserted and cancelled in constant
+ * time and expire with millisecond resolution. The innermost wheel has
+ * one slot per tick, the outer wheels hold timers further ahead and
+ * are cascaded inwards as time advances.
+ */
+
+class TimingWheel
+{
+public:
+
+    using ExpireCallback = std::function<void (uint32_t)>;
+
+    static uint64_t now();
+
+    TimingWheel();
+
+    bool add(uint32_t id, uint64_t deadline);
+
+    bool cancel(uint32_t id);
+
+    void clear();
+
+    uint32_t advance(uint64_t time, const ExpireCallback &callback);
+
+    uint64_t nextDeadline();
+
+    uint32_t size();
+
+protected:
+
+    struct Timer
+    {
+        uint64_t deadline;
+
+        uint32_t level;
+
+        uint32_t slot;
+
+        std::list<uint32_t>::iterator it;
+    };
+
+    void insert(uint32_t id, Timer &timer);
+
+    void cascade(uint32_t level);
+
+protected:
+
+    uint64_t m_tick;
+
+    std::vector<std::vector<std::list<uint32_t>>> m_wheels;
+
+    std::vector<uint32_t> m_counts;
+
+    std::unordered_map<uint32_t, Timer> m_timers;
+};
+
+// ============================================================ //
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/bufferpool.h"
+#include "Zway/memorybuffer.h"
+
+#include <map>
+
+namespace Zway {
+
+const uint32_t MAX_IDLE_PACKET_BYTES = 2097152;
+
+// ============================================================ //
+
+/**
+ * @brief BufferPool::create
+ * @param bufferSize
+ * @param maxIdle
+ * @return
+ */
+
+BufferPool$ BufferPool::create(uint32_t bufferSize, uint32_t maxIdle)
+{
+    if (!bufferSize) {
+
+        return nullptr;
+    }
+
+    return BufferPool$(new BufferPool(bufferSize, maxIdle));
+}
+
+/**
+ * @brief BufferPool::packetPool
+ * @param size
+ * @return
+ */
+
+BufferPool$ BufferPool::packetPool(uint32_t size)
+{
+    // there is one pool per power of two between MIN_PACKET_BODY
+    // and MAX_JUMBO_PACKET_BODY, the smallest one that fits wins
+
+    static ThreadSafe<std::map<uint32_t, BufferPool$>> pools;
+
+    if (size > MAX_JUMBO_PACKET_BODY) {
+
+        return nullptr;
+    }
+
+    uint32_t bufferSize = MIN_PACKET_BODY;
+
+    while (bufferSize < size) {
+
+        bufferSize <<= 1;
+    }
+
+    MutexLocker lock(pools);
+
+    BufferPool$ &pool = (*pools)[bufferSize];
+
+    if (!pool) {
+
+        uint32_t maxIdle = MAX_IDLE_PACKET_BYTES / bufferSize;
+
+        pool = create(bufferSize, maxIdle > 2 ? maxIdle : 2);
+    }
+
+    return pool;
+}
+
+/**
+ * @brief BufferPool::BufferPool
+ * @param bufferSize
+ * @param maxIdle
+ */
+
+BufferPool::BufferPool(uint32_t bufferSize, uint32_t maxIdle)
+    : m_bufferSize(bufferSize),
+      m_maxIdle(maxIdle)
+{
+
+}
+
+/**
+ * @brief BufferPool::lease
+ * @return
+ */
+
+MemoryBuffer$ BufferPool::lease()
+{
+    MemoryBuffer$ buffer;
+
+    {
+        MutexLocker lock(m_idle);
+
+        if (!m_idle->empty()) {
+
+            buffer = m_idle->front();
+
+            m_idle->pop_front();
+        }
+    }
+
+    if (!buffer) {
+
+        buffer = MemoryBuffer::create(nullptr, m_bufferSize);
+
+        if (!buffer) {
+
+            return nullptr;
+        }
+    }
+
+    // the returned pointer shares the buffer but puts it back
+    // into the pool instead of freeing it once released
+
+    std::weak_ptr<BufferPool> pool = shared_from_this();
+
+    return MemoryBuffer$(buffer.get(), [pool, buffer] (MemoryBuffer*) {
+
+        BufferPool$ p = pool.lock();
+
+        if (p) {
+
+            p->release(buffer);
+        }
+    });
+}
+
+/**
+ * @brief BufferPool::bufferSize
+ * @return
+ */
+
+uint32_t BufferPool::bufferSize()
+{
+    return m_bufferSize;
+}
+
+/**
+ * @brief BufferPool::numIdle
+ * @return
+ */
+
+uint32_t BufferPool::numIdle()
+{
+    MutexLocker lock(m_idle);
+
+    return m_idle->size();
+}
+
+/**
+ * @brief BufferPool::release
+ * @param buffer
+ */
+
+void BufferPool::release(MemoryBuffer$ buffer)
+{
+    buffer->clear();
+
+    MutexLocker lock(m_idle);
+
+    if (!m_maxIdle || m_idle->size() < m_maxIdle) {
+
+        m_idle->push_back(buffer);
+    }
+}
+
+// ============================================================ //
+
+}
@@ -27,6 +27,8 @@
 #include "Zway/bufferreceiver.h"
 #include "Zway/memorybuffer.h"
 
+#include <cstdint>
+
 namespace Zway {
 
 // ============================================================ //
@@ -62,7 +64,8 @@ BufferReceiver$ BufferReceiver::create(
 BufferReceiver::BufferReceiver(BufferReceiverCallback callback)
     : StreamReceiver(),
       m_callback(callback),
-      m_bytesReceived(0)
+      m_bytesReceived(0),
+      m_bodySize(0)
 {
 
 }
@@ -76,12 +79,34 @@ BufferReceiver::BufferReceiver(BufferReceiverCallback callback)
 
 bool BufferReceiver::init(const Packet &pkt, MemoryBuffer$ buffer)
 {
+    // buffered streams are always received from their first part
+
+    if (pkt.part() != 1) {
+
+        return false;
+    }
+
     if (!StreamReceiver::init(pkt)) {
 
         return false;
     }
 
-    m_buffer = buffer ? buffer : MemoryBuffer::create(nullptr, pkt.parts() * MAX_PACKET_BODY);
+    // the body size of the stream is taken from its first packet,
+    // all parts but the last one are sent with the full body size
+
+    m_bodySize = pkt.bodySize();
+
+    if (!m_bodySize || m_bodySize > MAX_JUMBO_PACKET_BODY) {
+
+        return false;
+    }
+
+    if ((uint64_t)pkt.parts() * m_bodySize > UINT32_MAX) {
+
+        return false;
+    }
+
+    m_buffer = buffer ? buffer : MemoryBuffer::create(nullptr, pkt.parts() * m_bodySize);
 
     if (!m_buffer) {
 
@@ -104,16 +129,52 @@ bool BufferReceiver::processPacket(Packet &pkt)
         return false;
     }
 
-    if (!m_buffer->write(pkt.bodyData(), pkt.bodySize(), (pkt.part()-1) * MAX_PACKET_BODY, nullptr)) {
+    if (pkt.bodySize() > m_bodySize) {
 
         return false;
     }
 
+    // bodies received in place are already where they belong
+
+    if (pkt.body() != m_buffer) {
+
+        if (!m_buffer->write(pkt.bodyData(), pkt.bodySize(), (pkt.part()-1) * m_bodySize, nullptr)) {
+
+            return false;
+        }
+    }
+
     m_bytesReceived += pkt.bodySize();
 
     return true;
 }
 
+/**
+ * @brief BufferReceiver::packetBuffer
+ * @param pkt
+ * @param offset
+ * @return
+ */
+
+MemoryBuffer$ BufferReceiver::packetBuffer(const Packet &pkt, uint32_t &offset)
+{
+    if (!m_buffer || !pkt.part() || pkt.bodySize() > m_bodySize) {
+
+        return nullptr;
+    }
+
+    uint64_t pos = (uint64_t)(pkt.part()-1) * m_bodySize;
+
+    if (pos + pkt.bodySize() > m_buffer->size()) {
+
+        return nullptr;
+    }
+
+    offset = pos;
+
+    return m_buffer;
+}
+
 /**
  * @brief BufferReceiver::buffer
  * @return
@@ -26,7 +26,9 @@
 
 #include "Zway/crypto/crypto.h"
 #include "Zway/crypto/rsa.h"
+#include "Zway/bufferpool.h"
 #include "Zway/memorybuffer.h"
+#include "Zway/spoolfilebuffer.h"
 #include "Zway/event/eventhandler.h"
 #include "Zway/message/message.h"
 #include "Zway/message/resource.h"
@@ -42,26 +44,62 @@
 #include "Zway/request/dispatchrequest.h"
 #include "Zway/request/pushrequest.h"
 #include "Zway/request/requestevent.h"
+#include "Zway/message/resourcesender.h"
 #include "Zway/store.h"
 #include "Zway/client.h"
+#include "Zway/clientruntime.h"
 
 #if !defined _WIN32
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include <iostream>
 
 #include <gnutls/gnutls.h>
 
+// kernel tls and sending files need gnutls 3.7.3
+
+#if defined __linux__ && GNUTLS_VERSION_NUMBER >= 0x030703
+#define ZWAY_KERNEL_TLS
+#include <gnutls/socket.h>
+#endif
+
 namespace Zway {
 
 const uint16_t ZWAY_PORT = 5557;
 
 const uint32_t RECONNECT_INTERVAL = 30000;
 
+const uint32_t CONNECT_TIMEOUT = 10000;
+
+const uint32_t MAX_STEP_PACKETS = 64;
+
+const uint32_t MAX_STEP_BATCHES = 4;
+
+const uint32_t MAX_CORKED_BYTES = 65536;
+
+const uint32_t MAX_SEND_WINDOW = 262144;
+
+const uint32_t RECEIVE_QUEUE_HIGH_WATERMARK = 4194304;
+
+const uint32_t RECEIVE_QUEUE_LOW_WATERMARK = 1048576;
+
+const uint32_t RECEIVE_QUEUE_CAPACITY = 4096;
+
+const uint32_t RECEIVE_BUFFER_SIZE = 32768;
+
+const uint32_t RECEIVE_DIRECT_SIZE = 16384;
+
+const uint32_t MAX_RESOURCE_UPLOADS = 8;
+
+const uint32_t MAX_MESSAGE_RESOURCE_UPLOADS = 4;
+
+const uint32_t MAX_CLIENT_WORKERS = 2;
+
 // ============================================================ //
 
 #if defined _WIN32
@@ -144,10 +182,26 @@ Client::Client(EventHandler$ handler)
       m_session(nullptr),
       m_anonCred(nullptr),
       m_certCred(nullptr),
+      m_corked(false),
       m_port(0),
       m_sender(this),
       m_receiver(this),
-      m_eventHandler(handler)
+      m_runtimeId(0),
+      m_resolver(Resolver::instance()),
+      m_resolveGeneration(0),
+      m_resolved(false),
+      m_resolving(false),
+      m_persistSessions(false),
+      m_numHandshakes(0),
+      m_numResumed(0),
+      m_handshakeTime(0),
+      m_authTime(0),
+      m_kernelTls(false),
+      m_kernelTlsActive(false),
+      m_eventHandler(handler),
+      m_resourceUploads(0),
+      m_maxResourceUploads(MAX_RESOURCE_UPLOADS),
+      m_maxMessageResourceUploads(MAX_MESSAGE_RESOURCE_UPLOADS)
 {
 
 }
@@ -165,10 +219,11 @@ Client::~Client()
  * @brief Client::start
  * @param host
  * @param port
+ * @param runtime runs the client if set, instead of threads of its own
  * @return
  */
 
-bool Client::start(const std::string& host, uint16_t port)
+bool Client::start(const std::string& host, uint16_t port, ClientRuntime$ runtime)
 {
     if (status() >= Started) {
 
@@ -197,6 +252,29 @@ bool Client::start(const std::string& host, uint16_t port)
 
     m_port = port;
 
+    m_runtime = runtime;
+
+    if (runtime) {
+
+        // connection, sending and receiving are driven by step()
+        // on the threads of the runtime
+
+        m_reconnectTime = std::chrono::steady_clock::now();
+
+        setStatus(Started);
+
+        if (!m_runtime->add(shared_from_this())) {
+
+            m_runtime = nullptr;
+
+            setStatus(Closed);
+
+            return false;
+        }
+
+        return true;
+    }
+
     // run client
 
     Thread::start();
@@ -207,6 +285,11 @@ bool Client::start(const std::string& host, uint16_t port)
 
     m_receiver.start(true);
 
+    // run the workers for incoming requests, they are
+    // started once requests come in
+
+    m_executor.start(MAX_CLIENT_WORKERS);
+
     // set status
 
     setStatus(Started);
@@ -226,11 +309,34 @@ bool Client::close()
         return false;
     }
 
-    // shutdown sender and receiver
+    // the runtime may hold the last reference, which
+    // has to outlive the rest of the shutdown
 
-    m_receiver.cancelAndJoin();
+    Client$ self;
 
-    m_sender.cancelAndJoin();
+    if (m_runtime) {
+
+        // waits for a step in progress
+
+        self = m_runtime->remove(m_runtimeId);
+
+        // incoming requests still pending are dropped, those being
+        // handled are waited for, they may still use the runtime
+
+        m_runtime->workers().cancel(m_runtimeId);
+    }
+    else {
+
+        // shutdown sender and receiver
+
+        m_receiver.cancelAndJoin();
+
+        m_sender.cancelAndJoin();
+
+        // incoming requests still pending are dropped
+
+        m_executor.stop();
+    }
 
     // shutdown engine
 
@@ -330,6 +436,13 @@ bool Client::request(const UBJ::Object &args, RequestCallback callback)
 
     if (request) {
 
+        // per request timeout in ms
+
+        if (args.hasField("timeout")) {
+
+            request->setTimeout(args["timeout"].toInt());
+        }
+
         return postRequest(request);
     }
 
@@ -421,6 +534,37 @@ bool Client::postMessage(Message$ message)
     return true;
 }
 
+/**
+ * @brief Client::wake
+ */
+
+void Client::wake()
+{
+    if (m_runtime) {
+
+        m_runtime->schedule(m_runtimeId);
+    }
+    else {
+
+        m_receiver.notify();
+    }
+}
+
+/**
+ * @brief Client::cancel
+ *
+ * Also interrupts a thread waiting for the socket.
+ */
+
+void Client::cancel()
+{
+    Thread::cancel();
+
+    m_reactor.wake();
+
+    m_resolveCondition.notify_all();
+}
+
 /**
  * @brief Client::addStreamSender
  * @param sender
@@ -429,16 +573,235 @@ bool Client::postMessage(Message$ message)
 
 bool Client::addStreamSender(StreamSender$ sender)
 {
+    // resources go out through kernel tls as spooled files,
+    // falling back to the usual path if there's no spool file
+
+    if (m_kernelTlsActive) {
+
+        ResourceSender$ resourceSender = std::dynamic_pointer_cast<ResourceSender>(sender);
+
+        if (resourceSender) {
+
+            resourceSender->enableSpooling();
+        }
+    }
+
     if (!Engine::addStreamSender(sender)) {
 
         return false;
     }
 
-    m_sender.notify();
+    if (m_runtime) {
+
+        m_runtime->schedule(m_runtimeId);
+    }
+    else {
+
+        m_sender.notify();
+    }
 
     return true;
 }
 
+/**
+ * @brief Client::setResourceUploadWindow
+ * @param perMessage
+ * @param total
+ *
+ * Sets how many resources of a message are sent at the same time and
+ * how many resource uploads the client runs at most altogether.
+ */
+
+void Client::setResourceUploadWindow(uint32_t perMessage, uint32_t total)
+{
+    MutexLocker locker(m_resourceUploadMutex);
+
+    m_maxMessageResourceUploads = perMessage ? perMessage : 1;
+
+    m_maxResourceUploads = total ? total : 1;
+}
+
+/**
+ * @brief Client::resourceUploadWindow
+ * @return
+ */
+
+uint32_t Client::resourceUploadWindow()
+{
+    MutexLocker locker(m_resourceUploadMutex);
+
+    return m_maxMessageResourceUploads;
+}
+
+/**
+ * @brief Client::setReceiveWatermarks
+ * @param low
+ * @param high
+ */
+
+void Client::setReceiveWatermarks(uint32_t low, uint32_t high)
+{
+    m_receiver.setWatermarks(low, high);
+}
+
+/**
+ * @brief Client::receiveStats
+ * @return
+ *
+ * Depth of the receive queue in packets and bytes, whether reading
+ * is paused, how often and how long (ms) it has been paused so far.
+ */
+
+UBJ::Object Client::receiveStats()
+{
+    return m_receiver.stats();
+}
+
+/**
+ * @brief Client::setSessionPersistence
+ * @param persist
+ *
+ * Keeps the data for resuming tls sessions in the store too, so that
+ * even the first connection after a restart may be resumed.
+ */
+
+void Client::setSessionPersistence(bool persist)
+{
+    m_persistSessions = persist;
+}
+
+/**
+ * @brief Client::sessionPersistence
+ * @return
+ */
+
+bool Client::sessionPersistence()
+{
+    return m_persistSessions;
+}
+
+/**
+ * @brief Client::connectionStats
+ * @return
+ *
+ * Handshakes run and resumed so far, the duration of the last one
+ * and the time from connecting to being authenticated, in ms.
+ */
+
+UBJ::Object Client::connectionStats()
+{
+    return UBJ_OBJ(
+                "handshakes"    << (uint32_t)m_numHandshakes <<
+                "resumed"       << (uint32_t)m_numResumed <<
+                "handshakeTime" << (uint32_t)m_handshakeTime <<
+                "authTime"      << (uint32_t)m_authTime <<
+                "kernelTls"     << (bool)m_kernelTlsActive);
+}
+
+/**
+ * @brief Client::setKernelTls
+ * @param enable
+ *
+ * Lets resource uploads of threaded clients go out through kernel tls,
+ * from a spool file the resource is encrypted into. GnuTLS hands the
+ * record layer to the kernel only if the system configuration enables
+ * ktls and the tls module is loaded, otherwise nothing changes. Takes
+ * effect on the next connect.
+ */
+
+void Client::setKernelTls(bool enable)
+{
+    m_kernelTls = enable;
+}
+
+/**
+ * @brief Client::kernelTls
+ * @return true if the current connection sends through kernel tls
+ */
+
+bool Client::kernelTls()
+{
+    return m_kernelTlsActive;
+}
+
+/**
+ * @brief Client::setResolver
+ * @param resolver
+ *
+ * Replaces the resolver shared by all clients, e.g. with a stub.
+ * Takes effect on the next connect.
+ */
+
+void Client::setResolver(Resolver$ resolver)
+{
+    m_resolver = resolver ? resolver : Resolver::instance();
+}
+
+/**
+ * @brief Client::resolver
+ * @return
+ */
+
+Resolver$ Client::resolver()
+{
+    return m_resolver;
+}
+
+/**
+ * @brief Client::acquireResourceUpload
+ * @param request
+ * @return
+ *
+ * Takes one of the global upload slots. If none is free the request
+ * is queued and continued when the next slot is released.
+ */
+
+bool Client::acquireResourceUpload(PushRequest$ request)
+{
+    MutexLocker locker(m_resourceUploadMutex);
+
+    if (m_resourceUploads < m_maxResourceUploads) {
+
+        m_resourceUploads++;
+
+        return true;
+    }
+
+    m_resourceUploadQueue.push_back(request);
+
+    return false;
+}
+
+/**
+ * @brief Client::releaseResourceUpload
+ */
+
+void Client::releaseResourceUpload()
+{
+    PushRequest$ request;
+
+    {
+        MutexLocker locker(m_resourceUploadMutex);
+
+        if (m_resourceUploads) {
+
+            m_resourceUploads--;
+        }
+
+        while (!request && !m_resourceUploadQueue.empty()) {
+
+            request = m_resourceUploadQueue.front().lock();
+
+            m_resourceUploadQueue.pop_front();
+        }
+    }
+
+    if (request) {
+
+        request->pushNext();
+    }
+}
+
 /**
  * @brief Client::status
  * @return
@@ -502,6 +865,12 @@ void Client::setStatus(Status status, bool event)
         m_status = status;
     }
 
+    if (status == Authenticated) {
+
+        m_authTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - m_connectStart).count();
+    }
+
     if (event) {
 
         postEvent(Event::create(Event::Status, UBJ_OBJ("status" << status)));
@@ -537,7 +906,17 @@ void Client::run()
         }
         else {
 
-            m_receiver.waitPacket(1000);
+            // sleep until a packet arrives or the next request times out
+
+            m_receiver.waitPacket(nextTimeout(1000));
+        }
+
+        // responses to a run of incoming packets go out in one batch
+        // once the client has caught up
+
+        if (!m_receiver.numPackets()) {
+
+            flushControl();
         }
 
         process();
@@ -545,506 +924,1305 @@ void Client::run()
 }
 
 /**
- * @brief Client::connect
- * @param host
- * @param port
- * @return
+ * @brief Client::step
+ * @return milliseconds until the client wants to run again
+ *
+ * One round of work for a client run by a ClientRuntime. It never
+ * blocks, the runtime calls it again when the socket becomes ready,
+ * the client is woken or the returned time has passed.
  */
 
-bool Client::connect(const std::string& host, uint32_t port)
+uint32_t Client::step()
 {
-    uint32_t a = inet_addr(host.c_str());
-
-    if (a == INADDR_NONE) {
+    auto now = std::chrono::steady_clock::now();
 
-        struct hostent* he = gethostbyname(host.c_str());
+    switch (status()) {
 
-        if (!he) {
+        case Started:
+        case Disconnected:
+        {
+            if (now < m_reconnectTime) {
 
-            //postEvent(MAKE_ERROR(0, "Failed to resolve hostname"));
+                return std::chrono::duration_cast<std::chrono::milliseconds>(m_reconnectTime - now).count() + 1;
+            }
 
-            return false;
-        }
+            if (!m_resolving) {
 
-        a = *(uint32_t*)he->h_addr;
-    }
+                m_connectStart = now;
 
-#if defined _WIN32
+                m_connectDeadline = now + std::chrono::milliseconds(CONNECT_TIMEOUT);
 
-    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                m_resolving = true;
 
-    if (s == INVALID_SOCKET) {
+                resolve(m_host, m_port);
+            }
 
-        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
+            // the resolver schedules the client when done
 
-        return false;
-    }
+            Resolver::AddressList addresses;
 
-    u_long on = 1;
+            int32_t res = resolveResult(addresses);
 
-    {
-        int32_t ret = ioctlsocket(s, FIONBIO, &on);
+            if (res == 0 && now < m_connectDeadline) {
 
-        if (ret != NO_ERROR) {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(m_connectDeadline - now).count() + 1;
+            }
 
-            // ...
-        }
-    }
+            m_resolving = false;
 
-#else
+            if (res != 1) {
 
-    int32_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                connectFailed();
 
-    if (s == -1) {
+                m_reconnectTime = now + std::chrono::milliseconds(RECONNECT_INTERVAL);
 
-        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
+                return RECONNECT_INTERVAL;
+            }
 
-        return false;
-    }
+            setStatus(Connecting);
 
-    int32_t flags = fcntl(s, F_GETFL, 0);
+            m_connector.start(addresses, [this] (intptr_t socket, bool add) {
 
-    fcntl(s, F_SETFL, flags | O_NONBLOCK);
+                return watch(socket, add);
+            });
 
-#endif
+            return 0;
+        }
 
-    // setup address and connect
+        case Connecting:
+        {
+            intptr_t socket = -1;
 
-    struct sockaddr_in addr;
-    addr.sin_addr.s_addr = a;
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(port);
+            int32_t res = m_connector.poll(socket);
 
-    setStatus(Connecting);
+            if (res == 0 && now < m_connectDeadline) {
 
-    int32_t res = ::connect(s, (struct sockaddr*)&addr, sizeof(addr));
+                uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(m_connectDeadline - now).count() + 1;
 
-#if defined _WIN32
+                return std::min(ms, m_connector.timeout());
+            }
 
-    if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            if (res == -1) {
 
-#else
+                m_resolver->invalidate(m_host, m_port);
+            }
 
-    if (errno == EINPROGRESS) {
+            if (res == 1) {
 
-#endif
-        // wait for socket to be connected
+                m_socket = socket;
 
-        uint32_t timeout = 10000;
-        uint32_t ms = 0;
+                setStatus(Connected);
 
-        while (ms < timeout) {
+                if (initSession()) {
 
-            if (canceled()) {
+                    m_connectDeadline = now + std::chrono::milliseconds(CONNECT_TIMEOUT);
 
-                return false;
+                    return 0;
+                }
             }
 
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 200000;
+            connectFailed();
 
-            fd_set ws;
-            FD_ZERO(&ws);
-            FD_SET(s, &ws);
+            m_reconnectTime = now + std::chrono::milliseconds(RECONNECT_INTERVAL);
 
-            if (select(s + 1, nullptr, &ws, nullptr, &tv) > 0) {
+            return RECONNECT_INTERVAL;
+        }
 
-                res = -1;
+        case Connected:
+        {
+            int32_t res = handshake();
 
-#if defined _WIN32
+            if (res == 0 && now < m_connectDeadline) {
 
-                uint32_t len = sizeof(int32_t);
+                return std::chrono::duration_cast<std::chrono::milliseconds>(m_connectDeadline - now).count() + 1;
+            }
 
-                getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&res, (int32_t*)&len);
-#else
+            if (res != 1) {
 
-                socklen_t len = sizeof(int32_t);
+                connectFailed();
 
-                getsockopt(s, SOL_SOCKET, SO_ERROR, &res, &len);
-#endif
+                m_reconnectTime = now + std::chrono::milliseconds(RECONNECT_INTERVAL);
 
-                break;
+                return RECONNECT_INTERVAL;
             }
 
-            ms += 200;
+            secured();
+
+            return 0;
         }
-    }
 
-    if (res) {
+        case Secure:
+        case Authenticated:
+            break;
 
-#if defined _WIN32
+        default:
+            return REACTOR_INFINITE;
+    }
 
-        closesocket(s);
+    // read until the socket runs dry, a client with lots of
+    // input gives the others a turn after some packets
 
-#else
+    uint32_t numPackets = 0;
 
-        ::close(s);
+    for (; numPackets < MAX_STEP_PACKETS; ++numPackets) {
 
-#endif
-        setStatus(Disconnected);
+        Packet pkt;
 
-        postEvent(ERROR_EVENT(Event::ConnectionFailure, "Connection failed"));
+        int32_t res = m_receiver.readPacket(pkt);
 
-        return false;
-    }
+        if (res < 0) {
 
-    m_socket = s;
+            disconnect(false);
 
-    setStatus(Connected);
+            m_reconnectTime = now;
 
-    // init tls session
+            return 0;
+        }
 
-    if ((res = gnutls_init((gnutls_session_t*)&m_session, GNUTLS_CLIENT)) < 0) {
+        if (res == 0) {
 
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+            break;
+        }
 
-        return false;
+        processIncomingPacket(pkt);
     }
 
-    // set priority
+    flushControl();
 
-    if ((res = gnutls_priority_set_direct((gnutls_session_t)m_session, "NORMAL:+VERS-TLS1.2", nullptr)) < 0) {
+    process();
 
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+    // send what the streams have, at most a few batches per step
 
-        return false;
+    int32_t res = Sender::More;
+
+    for (uint32_t i=0; i<MAX_STEP_BATCHES && res == Sender::More; ++i) {
+
+        res = m_sender.pump();
     }
 
-    // set credentials
+    if (res == Sender::Failed) {
 
-    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_ANON, m_anonCred)) < 0) {
+        disconnect(false);
 
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+        m_reconnectTime = now;
 
-        return false;
+        return 0;
     }
 
-    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_CERTIFICATE, m_certCred)) < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+    if (numPackets == MAX_STEP_PACKETS || res == Sender::More) {
 
-        return false;
+        return 0;
     }
 
-    // assign socket
+    return nextTimeout(REACTOR_INFINITE);
+}
 
-    gnutls_transport_set_ptr((gnutls_session_t)m_session, (gnutls_transport_ptr_t)(intptr_t)m_socket);
+/**
+ * @brief Client::connect
+ * @param host
+ * @param port
+ * @return
+ */
 
-    // perform handshake
+bool Client::connect(const std::string& host, uint32_t port)
+{
+    m_connectStart = std::chrono::steady_clock::now();
 
-    do {
+    auto deadline = m_connectStart + std::chrono::milliseconds(CONNECT_TIMEOUT);
 
-        res = gnutls_handshake((gnutls_session_t)m_session);
-    }
-    while (res < 0 && gnutls_error_is_fatal(res) == 0);
+    // wait for the addresses, cancel() interrupts the wait
 
-    if (res < 0) {
+    resolve(host, port);
 
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+    Resolver::AddressList addresses;
 
-        return false;
-    }
+    int32_t res = 0;
 
-    // TODO: verify server certificate here
+    for (;;) {
 
-    //parseCert();
+        auto now = std::chrono::steady_clock::now();
 
-    setStatus(Secure);
+        if (now >= deadline) {
 
+            break;
+        }
 
-    m_sender.resume();
+        uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
 
-    m_receiver.resume();
+        if ((res = resolveResult(addresses, ms)) != 0 || canceled()) {
 
+            break;
+        }
+    }
 
-    postEvent(Event::create(Event::ConnectionSuccess));
+    if (res != 1) {
 
+        connectFailed();
 
-    request(UBJ_OBJ("requestType" << Request::Login));
+        return false;
+    }
 
+    // race the connects, polling in slices to notice cancel()
 
-    return true;
-}
+    setStatus(Connecting);
 
-/**
- * @brief Client::reconnect
- * @return
- */
+    m_connector.start(addresses);
+
+    intptr_t socket = -1;
 
-bool Client::reconnect()
-{
     for (;;) {
 
-        if (connect(m_host, m_port)) {
+        if ((res = m_connector.poll(socket)) != 0) {
 
-            return true;
+            break;
         }
 
-        if (!wait(RECONNECT_INTERVAL)) {
+        auto now = std::chrono::steady_clock::now();
 
-            return false;
+        if (canceled() || now >= deadline) {
+
+            break;
         }
+
+        uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+
+        m_connector.wait(std::min(std::min(ms, m_connector.timeout()), (uint32_t)200));
     }
-}
 
-/**
- * @brief Client::disconnect
- * @param bye
- * @param event
- * @return
- */
+    if (res == -1) {
 
-bool Client::disconnect(bool bye, bool event)
-{
+        m_resolver->invalidate(host, port);
+    }
 
+    if (res != 1) {
 
-    m_sender.suspend();
+        connectFailed();
 
-    m_receiver.suspend();
+        return false;
+    }
 
+    m_socket = socket;
 
-    if (m_session) {
+    if (!m_reactor.attach(socket)) {
 
-        if (bye) {
+        connectFailed();
 
-            int32_t res = gnutls_bye((gnutls_session_t)m_session, GNUTLS_SHUT_RDWR);
+        return false;
+    }
 
-            if (gnutls_error_is_fatal(res)) {
+    setStatus(Connected);
 
-                // ...
-            }
-        }
+    if (!initSession()) {
 
-        gnutls_deinit((gnutls_session_t)m_session);
+        connectFailed();
 
-        m_session = nullptr;
+        return false;
     }
 
+    // perform handshake, waiting for the direction gnutls got stuck in
 
-    if (m_socket) {
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT);
 
-#if defined _WIN32
+    for (;;) {
 
-        closesocket(m_socket);
+        m_reactor.clear(Reactor::Readable | Reactor::Writable);
 
-#else
+        if ((res = handshake()) != 0) {
 
-        ::close(m_socket);
+            break;
+        }
 
-#endif
+        if (canceled() || std::chrono::steady_clock::now() >= deadline) {
 
-        m_socket = -1;
+            break;
+        }
 
-        setStatus(Disconnected);
+        uint32_t events = gnutls_record_get_direction((gnutls_session_t)m_session) ?
+                    Reactor::Writable : Reactor::Readable;
 
-        if (event) {
+        if (m_reactor.wait(events, 200) == -1) {
 
-            postEvent(Event::create(Event::Disconnected));
+            break;
         }
+    }
 
-        return true;
+    if (res != 1) {
+
+        connectFailed();
+
+        return false;
     }
 
-    return false;
+    secured();
+
+    return true;
 }
 
 /**
- * @brief Client::wait
- * @param ms
- * @return
+ * @brief Client::resolve
+ * @param host
+ * @param port
+ *
+ * Starts resolving the host, resolveResult() gets the addresses. A
+ * lookup still running from an earlier attempt is ignored.
  */
 
-bool Client::wait(uint32_t ms, uint32_t interval)
+void Client::resolve(const std::string& host, uint32_t port)
 {
-    uint32_t t = 0;
+    uint32_t generation;
 
-    while (t < ms) {
-
-        if (canceled()) {
+    {
+        MutexLocker lock(m_resolveMutex);
 
-            return false;
-        }
+        generation = ++m_resolveGeneration;
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        m_resolved = false;
 
-        t += interval;
+        m_addresses.clear();
     }
 
-    return true;
-}
+    std::weak_ptr<Client> weak = shared_from_this();
 
-/**
- * @brief Client::readable
- * @param ms
- * @return
- */
+    m_resolver->resolve(host, port, [weak, generation] (const Resolver::AddressList &addresses) {
 
-int32_t Client::readable(uint32_t ms)
-{
-    // check if there is data left from previous read
+        Client$ client = weak.lock();
 
-    if (gnutls_record_check_pending((gnutls_session_t)m_session)) {
+        if (!client) {
 
-        return 1;
-    }
+            return;
+        }
+
+        {
+            MutexLocker lock(client->m_resolveMutex);
 
-    // check socket read readiness
+            if (generation != client->m_resolveGeneration) {
 
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(m_socket, &rfds);
+                return;
+            }
 
-    struct timeval tv;
-    tv.tv_sec = ms >= 1000 ? ms / 1000 : 0;
-    tv.tv_usec = ms >= 1000 ? (ms % 1000) * 1000 : ms * 1000;
+            client->m_addresses = addresses;
 
-    int32_t res = select(m_socket+1, &rfds, nullptr, nullptr, &tv);
+            client->m_resolved = true;
+        }
 
-    if (res == -1) {
+        client->m_resolveCondition.notify_all();
 
-        return -1;
+        client->wake();
+    });
+}
+
+/**
+ * @brief Client::resolveResult
+ * @param addresses
+ * @param ms time to wait for the resolver
+ * @return 1 if resolved, 0 if still resolving, -1 if the lookup failed
+ */
+
+int32_t Client::resolveResult(Resolver::AddressList &addresses, uint32_t ms)
+{
+    std::unique_lock<std::mutex> lock(m_resolveMutex);
+
+    if (!m_resolved && ms) {
+
+        m_resolveCondition.wait_for(lock, std::chrono::milliseconds(ms), [this] () {
+
+            return m_resolved || canceled();
+        });
     }
 
-    if (FD_ISSET(m_socket, &rfds)) {
+    if (!m_resolved) {
 
-        return 1;
+        return 0;
     }
 
-    return 0;
+    addresses = m_addresses;
+
+    return addresses.empty() ? -1 : 1;
 }
 
 /**
- * @brief Client::writable
- * @param ms
+ * @brief Client::watch
+ * @param socket
+ * @param watch
  * @return
+ *
+ * Registers the sockets of the connect attempts with the runtime.
  */
 
-int32_t Client::writable(uint32_t ms)
+bool Client::watch(intptr_t socket, bool watch)
 {
-    // check socket write readiness
+    if (watch) {
 
-    fd_set wfds;
-    FD_ZERO(&wfds);
-    FD_SET(m_socket, &wfds);
+        return m_runtime->watch(m_runtimeId, socket);
+    }
 
-    struct timeval tv;
-    tv.tv_sec = ms >= 1000 ? ms / 1000 : 0;
-    tv.tv_usec = ms >= 1000 ? (ms % 1000) * 1000 : ms * 1000;
+    m_runtime->unwatch(socket);
 
-    int32_t res = select(m_socket+1, nullptr, &wfds, nullptr, &tv);
+    return true;
+}
 
-    if (FD_ISSET(m_socket, &wfds)) {
+/**
+ * @brief Client::connectFailed
+ */
 
-        return 1;
+void Client::connectFailed()
+{
+    m_connector.cancel();
+
+    if (!disconnect(false, false) && status() == Connecting) {
+
+        setStatus(Disconnected);
     }
 
-    return 0;
+    postEvent(ERROR_EVENT(Event::ConnectionFailure, "Connection failed"));
 }
 
 /**
- * @brief Client::send
- * @param data
- * @param size
+ * @brief Client::initSession
  * @return
  */
 
-uint32_t Client::send(uint8_t* data, uint32_t size)
+bool Client::initSession()
 {
-    uint32_t s = 0;
+    int32_t res;
 
-    while (s < size) {
+    // init tls session
 
-        if (canceled()) {
+    if ((res = gnutls_init((gnutls_session_t*)&m_session, GNUTLS_CLIENT)) < 0) {
 
-            break;
-        }
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
 
-        int32_t res = writable(200);
+        m_session = nullptr;
 
-        if (res == -1) {
+        return false;
+    }
 
-            return -1;
-        }
-        else
-        if (res == 0) {
+    // set priority, tls 1.3 resumes in one round trip
 
-            continue;
-        }
+    if ((res = gnutls_priority_set_direct((gnutls_session_t)m_session, "NORMAL:-VERS-ALL:+VERS-TLS1.3:+VERS-TLS1.2", nullptr)) < 0) {
 
-        int32_t ret = gnutls_record_send((gnutls_session_t)m_session, &data[s], size - s);
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
 
-        if (ret == GNUTLS_E_AGAIN) {
+        return false;
+    }
 
-        }
+    // set credentials
 
-        if (gnutls_error_is_fatal(ret)) {
+    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_ANON, m_anonCred)) < 0) {
 
-            return -1;
-        }
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
 
-        if (ret > 0) {
+        return false;
+    }
 
-            s += ret;
-        }
+    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_CERTIFICATE, m_certCred)) < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
     }
 
-    return s;
+    // resume the previous session with the host, tls 1.3 tickets
+    // arrive after the handshake and are saved as they come in
+
+    loadSession();
+
+    gnutls_session_set_ptr((gnutls_session_t)m_session, this);
+
+    gnutls_handshake_set_hook_function((gnutls_session_t)m_session,
+                GNUTLS_HANDSHAKE_NEW_SESSION_TICKET, GNUTLS_HOOK_POST,
+                [] (gnutls_session_t session, unsigned int, unsigned int, unsigned int, const gnutls_datum_t*) -> int {
+
+        ((Client*)gnutls_session_get_ptr(session))->saveSession();
+
+        return 0;
+    });
+
+    // assign socket
+
+    gnutls_transport_set_ptr((gnutls_session_t)m_session, (gnutls_transport_ptr_t)(intptr_t)m_socket);
+
+    m_handshakeStart = std::chrono::steady_clock::now();
+
+    return true;
 }
 
 /**
- * @brief Client::recv
- * @param data
- * @param size
- * @return
+ * @brief Client::handshake
+ * @return 1 when done, 0 if it would block, -1 on failure
  */
 
-uint32_t Client::recv(uint8_t* data, uint32_t size)
+int32_t Client::handshake()
 {
-    uint32_t s = 0;
+    int32_t res = gnutls_handshake((gnutls_session_t)m_session);
 
-    while (s < size) {
+    if (res >= 0) {
 
-        if (canceled()) {
+        return 1;
+    }
 
-            break;
-        }
+    if (gnutls_error_is_fatal(res)) {
 
-        int32_t res = readable(200);
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
 
-        if (res == -1) {
+        // don't offer the session again in case it was the reason,
+        // neither after a restart
 
-            return -1;
-        }
-        else
-        if (res == 0) {
+        {
+            MutexLocker lock(m_sessionCache);
 
-            continue;
+            m_sessionCache->erase(sessionKey());
         }
 
-        int32_t ret = gnutls_record_recv((gnutls_session_t)m_session, &data[s], size - s);
-
-        if (gnutls_error_is_fatal(ret)) {
+        if (m_persistSessions && m_store) {
 
-            return -1;
+            m_store->setTlsSession(sessionKey(), nullptr);
         }
 
-        if (ret > 0) {
-
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Client::secured
+ */
+
+void Client::secured()
+{
+    // TODO: verify server certificate here
+
+    //parseCert();
+
+    bool resumed = gnutls_session_is_resumed((gnutls_session_t)m_session) != 0;
+
+    m_numHandshakes++;
+
+    if (resumed) {
+
+        m_numResumed++;
+    }
+
+    m_handshakeTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - m_handshakeStart).count();
+
+    saveSession();
+
+    // a runtime never blocks on a file being sent
+
+    m_kernelTlsActive = false;
+
+#if defined ZWAY_KERNEL_TLS
+
+    if (m_kernelTls && !m_runtime) {
+
+        m_kernelTlsActive = (gnutls_transport_is_ktls_enabled((gnutls_session_t)m_session) & GNUTLS_KTLS_SEND) != 0;
+    }
+
+#endif
+
+    setStatus(Secure);
+
+
+    m_sender.resume();
+
+    m_receiver.resume();
+
+
+    postEvent(Event::create(Event::ConnectionSuccess, UBJ_OBJ("resumed" << resumed)));
+
+
+    request(UBJ_OBJ("requestType" << Request::Login));
+}
+
+/**
+ * @brief Client::sessionKey
+ * @return
+ */
+
+std::string Client::sessionKey()
+{
+    return m_host + ":" + std::to_string(m_port);
+}
+
+/**
+ * @brief Client::loadSession
+ */
+
+void Client::loadSession()
+{
+    MemoryBuffer$ session;
+
+    {
+        MutexLocker lock(m_sessionCache);
+
+        auto it = m_sessionCache->find(sessionKey());
+
+        if (it != m_sessionCache->end()) {
+
+            session = it->second;
+        }
+    }
+
+    if (!session && m_persistSessions && m_store) {
+
+        session = m_store->tlsSession(sessionKey());
+
+        if (session) {
+
+            MutexLocker lock(m_sessionCache);
+
+            (*m_sessionCache)[sessionKey()] = session;
+        }
+    }
+
+    if (session) {
+
+        gnutls_session_set_data((gnutls_session_t)m_session, session->data(), session->size());
+    }
+}
+
+/**
+ * @brief Client::saveSession
+ *
+ * Keeps the data for resuming the session on reconnect.
+ */
+
+void Client::saveSession()
+{
+    gnutls_session_t session = (gnutls_session_t)m_session;
+
+    // tls 1.3 session data is of no use until a ticket arrived
+
+    if (gnutls_protocol_get_version(session) == GNUTLS_TLS1_3 &&
+        !(gnutls_session_get_flags(session) & GNUTLS_SFLAGS_SESSION_TICKET)) {
+
+        return;
+    }
+
+    gnutls_datum_t data;
+
+    if (gnutls_session_get_data2(session, &data) < 0) {
+
+        return;
+    }
+
+    MemoryBuffer$ buffer = MemoryBuffer::create(data.data, data.size);
+
+    gnutls_free(data.data);
+
+    if (!buffer) {
+
+        return;
+    }
+
+    {
+        MutexLocker lock(m_sessionCache);
+
+        MemoryBuffer$ &cached = (*m_sessionCache)[sessionKey()];
+
+        // a resumed tls 1.2 session keeps its data
+
+        if (cached && cached->size() == buffer->size() &&
+            !memcmp(cached->data(), buffer->data(), buffer->size())) {
+
+            return;
+        }
+
+        cached = buffer;
+    }
+
+    if (m_persistSessions && m_store) {
+
+        m_store->setTlsSession(sessionKey(), buffer);
+    }
+}
+
+/**
+ * @brief Client::reconnect
+ * @return
+ */
+
+bool Client::reconnect()
+{
+    for (;;) {
+
+        if (connect(m_host, m_port)) {
+
+            return true;
+        }
+
+        if (!wait(RECONNECT_INTERVAL)) {
+
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Client::disconnect
+ * @param bye
+ * @param event
+ * @return
+ */
+
+bool Client::disconnect(bool bye, bool event)
+{
+
+
+    m_sender.suspend();
+
+    m_receiver.suspend();
+
+
+    if (m_session) {
+
+        if (bye) {
+
+            int32_t res = gnutls_bye((gnutls_session_t)m_session, GNUTLS_SHUT_RDWR);
+
+            if (gnutls_error_is_fatal(res)) {
+
+                // ...
+            }
+        }
+
+        gnutls_deinit((gnutls_session_t)m_session);
+
+        m_session = nullptr;
+
+        m_corked = false;
+    }
+
+
+    if (m_socket != -1) {
+
+        // threads waiting for the socket return an error
+
+        if (m_runtime) {
+
+            m_runtime->unwatch(m_socket);
+        }
+        else {
+
+            m_reactor.detach();
+        }
+
+        m_receiver.resetRead();
+
+#if defined _WIN32
+
+        closesocket(m_socket);
+
+#else
+
+        ::close(m_socket);
+
+#endif
+
+        m_socket = -1;
+
+        // body size, compression and batching have to be negotiated
+        // again on next login
+
+        setPacketBodySize(MAX_PACKET_BODY);
+
+        setCompression(false);
+
+        setBatching(false);
+
+        // the peer dropped the streams along with the connection, the
+        // stream senders fail when they come up next and release their
+        // upload slots, packets queued for sending are discarded
+
+        dropStreams();
+
+        m_sender.clear();
+
+        // pushes waiting for an upload slot give up their resources
+
+        std::list<std::weak_ptr<PushRequest>> queue;
+
+        {
+            MutexLocker locker(m_resourceUploadMutex);
+
+            queue.swap(m_resourceUploadQueue);
+        }
+
+        for (auto &it : queue) {
+
+            if (PushRequest$ request = it.lock()) {
+
+                request->pushNext();
+            }
+        }
+
+        setStatus(Disconnected);
+
+        if (event) {
+
+            postEvent(Event::create(Event::Disconnected));
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Client::wait
+ * @param ms
+ * @return
+ */
+
+bool Client::wait(uint32_t ms, uint32_t interval)
+{
+    uint32_t t = 0;
+
+    while (t < ms) {
+
+        if (canceled()) {
+
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+
+        t += interval;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Client::readable
+ * @param ms
+ * @return
+ */
+
+int32_t Client::readable(uint32_t ms)
+{
+    // check if there is data left from previous read
+
+    if (gnutls_record_check_pending((gnutls_session_t)m_session)) {
+
+        return 1;
+    }
+
+    // wait for a read event, returns early if woken
+
+    int32_t res = m_reactor.wait(Reactor::Readable, ms);
+
+    if (res == -1) {
+
+        return -1;
+    }
+
+    if (res & (Reactor::Readable | Reactor::Error)) {
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Client::writable
+ * @param ms
+ * @return
+ */
+
+int32_t Client::writable(uint32_t ms)
+{
+    // wait for a write event, returns early if woken
+
+    int32_t res = m_reactor.wait(Reactor::Writable, ms);
+
+    if (res == -1) {
+
+        return -1;
+    }
+
+    if (res & (Reactor::Writable | Reactor::Error)) {
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Client::send
+ * @param data
+ * @param size
+ * @return
+ */
+
+uint32_t Client::send(uint8_t* data, uint32_t size)
+{
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        if (canceled()) {
+
+            break;
+        }
+
+        // the write event is cleared before the attempt, an event
+        // arriving after it makes the wait below return at once
+
+        m_reactor.clear(Reactor::Writable);
+
+        int32_t ret = gnutls_record_send((gnutls_session_t)m_session, &data[s], size - s);
+
+        if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED) {
+
+            // wait for the socket to drain instead of polling it before
+            // every send, a corked session never gets here as it only
+            // appends to the gnutls send buffer
+
+            if (writable(200) == -1) {
+
+                return -1;
+            }
+
+            continue;
+        }
+
+        if (gnutls_error_is_fatal(ret)) {
+
+            return -1;
+        }
+
+        if (ret > 0) {
+
+            s += ret;
+        }
+    }
+
+    return s;
+}
+
+/**
+ * @brief Client::sendFile
+ * @param fd
+ * @param offset
+ * @param size
+ * @return
+ *
+ * With kernel tls the pages are encrypted and sent by the kernel,
+ * straight from the page cache. Otherwise the range is copied through
+ * send, the gnutls fallback of gnutls_record_send_file does not resume
+ * a record after GNUTLS_E_AGAIN.
+ */
+
+uint32_t Client::sendFile(int32_t fd, uint32_t offset, uint32_t size)
+{
+#if defined ZWAY_KERNEL_TLS
+
+    if (!m_kernelTlsActive) {
+
+        uint8_t data[16384];
+
+        uint32_t s = 0;
+
+        while (s < size) {
+
+            uint32_t n = size - s < sizeof(data) ? size - s : sizeof(data);
+
+            if (pread(fd, data, n, offset + s) != (ssize_t)n) {
+
+                return -1;
+            }
+
+            // failures come back as (uint32_t)-1, a cancel sends less
+
+            uint32_t r = send(data, n);
+
+            if (r == (uint32_t)-1 || r < n) {
+
+                return -1;
+            }
+
+            s += n;
+        }
+
+        return s;
+    }
+
+    // corked data precedes the file
+
+    if (uncork() < 0) {
+
+        return -1;
+    }
+
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        if (canceled()) {
+
+            break;
+        }
+
+        m_reactor.clear(Reactor::Writable);
+
+        off_t pos = offset + s;
+
+        ssize_t ret = gnutls_record_send_file((gnutls_session_t)m_session, fd, &pos, size - s);
+
+        if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED) {
+
+            if (writable(200) == -1) {
+
+                return -1;
+            }
+
+            continue;
+        }
+
+        if (ret < 0 && gnutls_error_is_fatal(ret)) {
+
+            return -1;
+        }
+
+        if (ret > 0) {
+
             s += ret;
         }
     }
 
     return s;
+
+#else
+
+    return -1;
+
+#endif
+}
+
+/**
+ * @brief Client::cork
+ */
+
+void Client::cork()
+{
+    if (!m_corked) {
+
+        gnutls_record_cork((gnutls_session_t)m_session);
+
+        m_corked = true;
+    }
+}
+
+/**
+ * @brief Client::uncork
+ * @param block
+ * @return
+ *
+ * Without blocking, a flush that would block returns 0 and leaves the
+ * session corked, the next call continues it.
+ */
+
+int32_t Client::uncork(bool block)
+{
+    if (!m_corked) {
+
+        return 0;
+    }
+
+    int32_t ret = 0;
+
+    for (;;) {
+
+        if (canceled()) {
+
+            return -1;
+        }
+
+        // flush buffered data, gnutls stays corked until
+        // everything has been written to the socket
+
+        m_reactor.clear(Reactor::Writable);
+
+        ret = gnutls_record_uncork((gnutls_session_t)m_session, 0);
+
+        if (ret >= 0) {
+
+            break;
+        }
+
+        if (ret != GNUTLS_E_AGAIN && ret != GNUTLS_E_INTERRUPTED) {
+
+            return -1;
+        }
+
+        if (!block) {
+
+            return 0;
+        }
+
+        if (writable(200) == -1) {
+
+            return -1;
+        }
+    }
+
+    m_corked = false;
+
+    return ret;
+}
+
+/**
+ * @brief Client::recvSome
+ * @param data
+ * @param size
+ * @return the bytes read, 0 if it would block, -1 if the connection
+ *         was closed or failed
+ */
+
+int32_t Client::recvSome(uint8_t* data, uint32_t size)
+{
+    for (;;) {
+
+        // a threaded client waits for the next event once this
+        // runs dry, the socket may hold more after a read
+
+        if (!m_runtime) {
+
+            m_reactor.clear(Reactor::Readable);
+        }
+
+        int32_t ret = gnutls_record_recv((gnutls_session_t)m_session, data, size);
+
+        if (ret > 0) {
+
+            if (!m_runtime) {
+
+                m_reactor.set(Reactor::Readable);
+            }
+
+            return ret;
+        }
+
+        if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED) {
+
+            return 0;
+        }
+
+        if (ret == 0 || gnutls_error_is_fatal(ret)) {
+
+            return -1;
+        }
+
+        // non-fatal alert, try again
+    }
+}
+
+/**
+ * @brief Client::processIncomingRequest
+ * @param request
+ * @return
+ *
+ * Completed incoming requests are handled on the worker pool, so a slow
+ * request doesn't hold up reading the others. Requests with the same
+ * dispatch key are handled in order.
+ */
+
+bool Client::processIncomingRequest(const UBJ::Object &request)
+{
+    if (m_runtime) {
+
+        // the workers are shared, the client may be gone by the time
+        // the request comes up
+
+        std::weak_ptr<Client> client = shared_from_this();
+
+        return m_runtime->workers().post(m_runtime->dispatchKey(m_runtimeId, dispatchKey(request)), [client, request] () {
+
+            if (Client$ c = client.lock()) {
+
+                c->dispatchIncomingRequest(request);
+            }
+        }, m_runtimeId);
+    }
+
+    if (!m_executor.running()) {
+
+        return dispatchIncomingRequest(request);
+    }
+
+    return m_executor.post(dispatchKey(request), [this, request] () {
+
+        dispatchIncomingRequest(request);
+    });
+}
+
+/**
+ * @brief Client::dispatchKey
+ * @param request
+ * @return
+ *
+ * Requests of a contact are keyed by its id alone, whatever their
+ * type, so that an accepted contact request is handled before the
+ * pushes from the new contact. Requests not tied to a single contact
+ * are keyed by type and request id and run in parallel.
+ */
+
+uint64_t Client::dispatchKey(const UBJ::Object &request)
+{
+    uint32_t type = request["requestType"].toInt();
+
+    uint32_t contactId = 0;
+
+    switch (type) {
+
+        case Request::AcceptContact:
+
+            contactId = request["contactId"].toInt();
+
+            break;
+
+        case Request::ContactStatus: {
+
+            UBJ::Array status = request["contactStatus"].toArray();
+
+            if (status.size() == 1) {
+
+                contactId = status[0]["contactId"].toInt();
+            }
+
+            break;
+        }
+
+        case Request::Push:
+
+            contactId = request["src"].toInt();
+
+            break;
+    }
+
+    // the types fill the upper half, keys of contacts never meet them
+
+    if (contactId) {
+
+        return contactId;
+    }
+
+    return ((uint64_t)type << 32) | (uint32_t)request["requestId"].toInt();
 }
 
 /**
- * @brief Client::processIncomingRequest
+ * @brief Client::dispatchIncomingRequest
  * @param request
  * @return
  */
 
-bool Client::processIncomingRequest(const UBJ::Object &request)
+bool Client::dispatchIncomingRequest(const UBJ::Object &request)
 {
     switch (request["requestType"].toInt()) {
 
@@ -1094,7 +2272,7 @@ StreamReceiver$ Client::createStreamReceiver(const Packet &packet)
 
         if (!m_store->query(
                     "resources",
-                    UBJ_OBJ("id" << resourceId << "status" << 0),
+                    UBJ_OBJ("id" << resourceId),
                     &resource)) {
 
             // ...
@@ -1102,6 +2280,15 @@ StreamReceiver$ Client::createStreamReceiver(const Packet &packet)
             return nullptr;
         }
 
+        // a resource is either new or an interrupted transfer
+
+        uint32_t status = resource["status"].toInt();
+
+        if (status != Resource::Unknown && status != Resource::Incoming) {
+
+            return nullptr;
+        }
+
         // get request record
 
         UBJ::Object request;
@@ -1124,32 +2311,98 @@ StreamReceiver$ Client::createStreamReceiver(const Packet &packet)
 
         MemoryBuffer$ salt = PushRequest::resourceSalt(request["data"]["salt"].buffer(), resourceId);
 
-        // create resource receiver
+        uint64_t blobId = resource["data"].toInt();
 
-        ResourceReceiver$ receiver = ResourceReceiver::create(
-                    packet, key, salt,
-                    [this, request] (BufferReceiver$ receiver, MemoryBuffer$ buffer, uint32_t bytesReceived) {
+        uint32_t bodySize = 0;
 
-                        if (receiver->status() == ResourceReceiver::Completed) {
+        UBJ::Store::Blob$ blob;
 
-                            uint64_t blobId = m_store->queryInt("resources", "data", UBJ_OBJ("id" << receiver->id()));
+        if (packet.part() > 1) {
 
-                            if (blobId) {
+            // resume an interrupted transfer, the stream has to continue
+            // right after the last part checkpointed into the blob
 
-                                m_store->removeBlob("blob3", blobId);
-                            }
+            if (!blobId || (uint32_t)resource["part"].toInt() + 1 != packet.part()) {
 
-                            // create resource blob
+                return nullptr;
+            }
 
-                            blobId = m_store->createBlob("blob3", buffer);
+            bodySize = resource["partSize"].toInt();
 
-                            // ...
+            if (!bodySize) {
+
+                return nullptr;
+            }
+
+            blob = m_store->openBlob("blob3", blobId, false);
+
+            if (!blob) {
+
+                return nullptr;
+            }
+        }
+        else {
+
+            // remove blob of an earlier, incomplete transfer
+
+            if (blobId) {
+
+                m_store->removeBlob("blob3", blobId);
+            }
+
+            // create a resource blob of the announced size up front,
+            // the receiver writes each part into it as it arrives
+
+            uint32_t size = resource["size"].toInt();
+
+            if (!size) {
+
+                return nullptr;
+            }
+
+            blobId = m_store->createBlob("blob3", size);
+
+            if (!blobId) {
+
+                return nullptr;
+            }
+
+            if (!m_store->update(
+                        "resources",
+                        UBJ_OBJ("data" << blobId << "part" << 0 << "partSize" << 0),
+                        UBJ_OBJ("id" << resourceId))) {
+
+                m_store->removeBlob("blob3", blobId);
+
+                return nullptr;
+            }
+
+            blob = m_store->openBlob("blob3", blobId, false);
+
+            if (!blob) {
+
+                return nullptr;
+            }
+        }
+
+        // create resource receiver
+
+        ResourceReceiver$ receiver = ResourceReceiver::create(
+                    packet, key, salt, blob,
+                    [this, request] (BufferReceiver$ receiver, MemoryBuffer$ buffer, uint32_t bytesReceived) {
+
+                        // the parts went to the blob, there is no buffer
+
+                        (void)buffer;
+
+                        if (receiver->status() == ResourceReceiver::Completed) {
 
-                            // update resource
+                            // update resource, its data was
+                            // written to the blob part by part
 
                             if (!m_store->update(
                                         "resources",
-                                        UBJ_OBJ("status" << Resource::Received << "data" << blobId),
+                                        UBJ_OBJ("status" << Resource::Received << "part" << receiver->parts()),
                                         UBJ_OBJ("id" << receiver->id()))) {
 
                                 // ...
@@ -1230,10 +2483,25 @@ StreamReceiver$ Client::createStreamReceiver(const Packet &packet)
 
                             // ...
                         }
-                    });
+                    },
+                    bodySize);
 
         if (receiver) {
 
+            // record the parts that made it into the blob, an interrupted
+            // transfer is resumed after the last of them
+
+            receiver->setCheckpointCallback([this] (ResourceReceiver$ receiver, uint32_t part) {
+
+                if (!m_store->update(
+                            "resources",
+                            UBJ_OBJ("part" << part << "partSize" << receiver->bodySize()),
+                            UBJ_OBJ("id" << receiver->id()))) {
+
+                    // ...
+                }
+            });
+
             // update resource status
 
             if (!m_store->update(
@@ -1682,7 +2950,23 @@ bool Client::processPush(const UBJ::Object &request)
                 }
                 else {
 
-                    // ...
+                    // ask for the remaining parts only if an earlier
+                    // transfer of the resource got interrupted
+
+                    UBJ::Object resource;
+
+                    if (m_store->query("resources", UBJ_OBJ("id" << it["id"]), &resource) &&
+                        resource["status"].toInt() == Resource::Incoming &&
+                        resource["part"].toInt() > 0 &&
+                        resource["partSize"].toInt() > 0) {
+
+                        resourceIds << UBJ_OBJ(
+                                           "id"       << it["id"] <<
+                                           "part"     << resource["part"].toInt() + 1 <<
+                                           "bodySize" << resource["partSize"]);
+
+                        continue;
+                    }
                 }
 
                 resourceIds << it["id"];
@@ -1756,7 +3040,9 @@ bool Client::processMessage(const UBJ::Object &request, const UBJ::Object &meta,
  */
 
 Sender::Sender(Client *client)
-    : m_client(client)
+    : m_client(client),
+      m_corkedBytes(0),
+      m_queuedBytes(0)
 {
 
 }
@@ -1768,9 +3054,7 @@ Sender::Sender(Client *client)
 
 uint32_t Sender::numPackets()
 {
-    MutexLocker lock(m_queue);
-
-    return m_queue->size();
+    return numElements();
 }
 
 /**
@@ -1780,7 +3064,37 @@ uint32_t Sender::numPackets()
 
 void Sender::process(Packet$ &packet)
 {
-    sendPacket(packet);
+    // keep the session corked while working off the packets drained
+    // by getElements(), so that packet heads and bodies are coalesced
+    // into full tls records instead of one record per send call
+
+    m_client->cork();
+
+    uint32_t s = sendPacket(packet);
+
+    if (s != (uint32_t)-1) {
+
+        m_corkedBytes += s;
+    }
+
+    // the packet leaves the send window, pull more from the stream
+    // senders once half of the window has drained to the socket
+
+    m_queuedBytes -= sizeof(Packet::Head) + packet->bodySize();
+
+    if (m_queuedBytes < MAX_SEND_WINDOW / 2) {
+
+        fillWindow();
+    }
+
+    // flush when this was the last queued packet or enough data piled up
+
+    if (!numPackets() || m_corkedBytes >= MAX_CORKED_BYTES) {
+
+        m_client->uncork();
+
+        m_corkedBytes = 0;
+    }
 }
 
 /**
@@ -1790,142 +3104,466 @@ void Sender::process(Packet$ &packet)
 
 bool Sender::getElements()
 {
-    if (m_client->numStreamSenders()) {
+    fillWindow();
+
+    return numPackets() > 0;
+}
+
+/**
+ * @brief Sender::cleared
+ *
+ * The packets of a lost connection were dropped, along with their
+ * share of the send window.
+ */
+
+void Sender::cleared()
+{
+    m_queuedBytes = 0;
+
+    m_corkedBytes = 0;
+}
+
+/**
+ * @brief Sender::fillWindow
+ * @return
+ *
+ * Pulls packets from the stream senders until the bytes queued for
+ * sending reach the send window, which bounds the memory held by
+ * queued packets and the time a new packet waits behind them.
+ */
+
+bool Sender::fillWindow()
+{
+    if (!m_client->numStreamSenders()) {
+
+        return false;
+    }
+
+    bool res = false;
+
+    while (m_queuedBytes < MAX_SEND_WINDOW) {
+
+        // runs on the sender thread, so posting never blocks
+
+        int32_t numPackets = m_client->processStreamSenders([this] (Packet$ pkt) -> bool {
+
+            m_queuedBytes += sizeof(Packet::Head) + pkt->bodySize();
+
+            post(std::move(pkt));
+
+            return true;
+        });
+
+        if (numPackets <= 0) {
+
+            break;
+        }
+
+        res = true;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Sender::queuedBytes
+ * @return
+ */
+
+uint32_t Sender::queuedBytes()
+{
+    return m_queuedBytes;
+}
+
+/**
+ * @brief Sender::sendPacket
+ * @param pkt
+ * @return
+ */
+
+uint32_t Sender::sendPacket(Packet$ pkt)
+{
+    uint32_t s = 0;
+
+    uint32_t r = m_client->send((uint8_t*)&pkt->head(), sizeof(Packet::Head));
+
+    if (r == (uint32_t)-1 || r < sizeof(Packet::Head)) {
+
+        return -1;
+    }
+
+    s += r;
+
+    if (pkt->bodySize() > 0) {
+
+        if (pkt->bodyFile()) {
+
+            r = m_client->sendFile(pkt->bodyFile()->fd(), pkt->bodyOffset(), pkt->bodySize());
+        }
+        else {
+
+            r = m_client->send(pkt->bodyData(), pkt->bodySize());
+        }
+
+        if (r == (uint32_t)-1 || r < pkt->bodySize()) {
+
+            return -1;
+        }
+
+        s += r;
+    }
+
+    return s;
+}
+
+/**
+ * @brief Sender::pump
+ * @return
+ *
+ * Sends without a thread of its own, for clients run by a ClientRuntime.
+ * A batch of packets is corked into the gnutls buffer and flushed without
+ * blocking, a flush that would block is continued by the next call.
+ */
+
+Sender::PumpResult Sender::pump()
+{
+    if (m_client->m_corked) {
+
+        if (m_client->uncork(false) < 0) {
+
+            return Failed;
+        }
+
+        if (m_client->m_corked) {
+
+            return Blocked;
+        }
+    }
+
+    if (!m_client->numStreamSenders()) {
+
+        return Done;
+    }
+
+    // a corked session takes every packet without blocking
+
+    m_client->cork();
+
+    uint32_t bytes = 0;
+
+    while (bytes < MAX_CORKED_BYTES) {
+
+        int32_t numPackets = m_client->processStreamSenders([this, &bytes] (Packet$ pkt) -> bool {
+
+            uint32_t s = sendPacket(pkt);
 
-        MutexLocker lock(m_queue);
+            if (s == (uint32_t)-1) {
 
-        m_client->processStreamSenders(true, [this] (Packet$ pkt) -> bool {
+                return false;
+            }
 
-            m_queue->push_back(pkt);
+            bytes += s;
 
             return true;
         });
 
-        if (!m_queue->empty()) {
+        if (numPackets <= 0) {
+
+            break;
+        }
+    }
+
+    if (m_client->uncork(false) < 0) {
+
+        return Failed;
+    }
+
+    if (m_client->m_corked) {
+
+        return Blocked;
+    }
+
+    return bytes ? More : Done;
+}
+
+// ============================================================ //
+
+/**
+ * @brief Receiver::Receiver
+ * @param client
+ */
+
+Receiver::Receiver(Client *client)
+    : m_client(client),
+      m_busy(false),
+      m_waiting(false),
+      m_signaled(false),
+      m_packetQueue(RECEIVE_QUEUE_CAPACITY),
+      m_queuedBytes(0),
+      m_lowWatermark(RECEIVE_QUEUE_LOW_WATERMARK),
+      m_highWatermark(RECEIVE_QUEUE_HIGH_WATERMARK),
+      m_paused(false),
+      m_queueFull(false),
+      m_numPauses(0),
+      m_pausedTime(0),
+      m_readOffset(0),
+      m_readBodyOffset(0),
+      m_bufferBegin(0),
+      m_bufferEnd(0),
+      m_bufferCharged(false),
+      m_numReads(0),
+      m_numReadPackets(0)
+{
+
+}
+
+/**
+ * @brief Receiver::cancel
+ */
+
+void Receiver::cancel()
+{
+    Thread::cancel();
+
+    notify();
+
+    m_client->m_reactor.wake();
+
+    {
+        MutexLocker lock(m_flowMutex);
+
+        m_drainedCondition.notify_all();
+    }
+}
+
+/**
+ * @brief Receiver::busy
+ * @return
+ */
+
+bool Receiver::busy()
+{
+    return m_busy;
+}
+
+/**
+ * @brief Receiver::wait
+ *
+ * Waits like Handler::wait(), a packet or notify racing the wait
+ * ends it instead of being left for the timeout.
+ */
+
+void Receiver::waitPacket(uint32_t ms)
+{
+    if (running()) {
+
+        m_waiting = true;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+
+            m_waitCondition.wait_for(lock, std::chrono::milliseconds(ms), [this] () {
 
-            return true;
+                return m_signaled.load() || !m_packetQueue.empty() || canceled();
+            });
         }
-    }
 
-    return false;
+        m_waiting = false;
+
+        m_signaled = false;
+    }
 }
 
 /**
- * @brief Sender::sendPacket
+ * @brief Receiver::fetchPacket
  * @param pkt
  * @return
  */
 
-uint32_t Sender::sendPacket(Packet$ pkt)
+bool Receiver::fetchPacket(Packet &pkt)
 {
-    uint32_t s = 0;
-
-    uint32_t r = m_client->send((uint8_t*)&pkt->head(), sizeof(Packet::Head));
+    QueuedPacket queued;
 
-    if (r < sizeof(Packet::Head)) {
+    if (!m_packetQueue.pop(queued)) {
 
-        return -1;
+        return false;
     }
 
-    s += r;
+    pkt = std::move(queued.packet);
 
-    if (pkt->bodySize() > 0) {
+    uint32_t queuedBytes = m_queuedBytes -= queued.bytes;
 
-        r = m_client->send(pkt->bodyData(), pkt->bodySize());
+    // the receiver thread waits for a free cell, see waitPush()
 
-        if (r < pkt->bodySize()) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-            return -1;
-        }
+    if (m_queueFull.load(std::memory_order_relaxed)) {
 
-        s += r;
+        MutexLocker lock(m_flowMutex);
+
+        m_queueFull = false;
+
+        m_drainedCondition.notify_all();
     }
 
-    return s;
-}
+    // continue reading the socket once the client caught up
 
-// ============================================================ //
+    if (m_paused && queuedBytes <= m_lowWatermark) {
+
+        MutexLocker lock(m_flowMutex);
+
+        resumeReading();
+    }
+
+    return true;
+}
 
 /**
- * @brief Receiver::Receiver
- * @param client
+ * @brief Receiver::numPackets
+ * @return
  */
 
-Receiver::Receiver(Client *client)
-    : m_client(client)
+uint32_t Receiver::numPackets()
 {
-
+    return m_packetQueue.size();
 }
 
 /**
- * @brief Receiver::cancel
+ * @brief Receiver::setWatermarks
+ * @param low
+ * @param high
+ *
+ * Reading the socket pauses when the packets queued for the client
+ * thread hold more than high bytes and continues at low bytes or less.
+ * Packets sharing a receive buffer count for all of it.
  */
 
-void Receiver::cancel()
+void Receiver::setWatermarks(uint32_t low, uint32_t high)
 {
-    Thread::cancel();
+    MutexLocker lock(m_flowMutex);
 
-    notify();
+    m_highWatermark = high ? high : RECEIVE_QUEUE_HIGH_WATERMARK;
+
+    m_lowWatermark = low < m_highWatermark ? low : m_highWatermark / 2;
+
+    if (m_paused && m_queuedBytes <= m_lowWatermark) {
+
+        m_drainedCondition.notify_all();
+    }
 }
 
 /**
- * @brief Receiver::busy
+ * @brief Receiver::stats
  * @return
  */
 
-bool Receiver::busy()
+UBJ::Object Receiver::stats()
 {
-    MutexLocker locker(m_busy);
+    MutexLocker lock(m_flowMutex);
 
-    return m_busy;
+    uint64_t pausedTime = m_pausedTime;
+
+    if (m_paused) {
+
+        pausedTime += std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - m_pausedSince).count();
+    }
+
+    return UBJ_OBJ(
+                "packets"    << m_packetQueue.size() <<
+                "bytes"      << (uint32_t)m_queuedBytes <<
+                "paused"     << (bool)m_paused <<
+                "pauses"     << m_numPauses <<
+                "pausedTime" << pausedTime <<
+                "reads"      << (uint32_t)m_numReads <<
+                "readPackets"<< (uint32_t)m_numReadPackets);
 }
 
 /**
- * @brief Receiver::wait
+ * @brief Receiver::waitDrained
+ * @param ms
+ * @return
+ *
+ * Waits while reading is paused, returns true if it may continue.
  */
 
-void Receiver::waitPacket(uint32_t ms)
+bool Receiver::waitDrained(uint32_t ms)
 {
-    if (running() && !canceled() && !numPackets()) {
+    std::unique_lock<std::mutex> lock(m_flowMutex);
 
-        std::unique_lock<std::mutex> lock(m_waitMutex);
+    if (m_paused && m_queuedBytes > m_lowWatermark) {
 
-        m_waitCondition.wait_for(lock, std::chrono::milliseconds(ms));
+        m_drainedCondition.wait_for(lock, std::chrono::milliseconds(ms));
     }
+
+    resumeReading();
+
+    return !m_paused;
 }
 
 /**
- * @brief Receiver::fetchPacket
- * @param pkt
- * @return
+ * @brief Receiver::resumeReading
+ *
+ * Ends a pause if the queue has drained, expects m_flowMutex locked.
  */
 
-bool Receiver::fetchPacket(Packet &pkt)
+void Receiver::resumeReading()
 {
-    MutexLocker lock(m_packetQueue);
-
-    if (!m_packetQueue->empty()) {
+    if (m_paused && m_queuedBytes <= m_lowWatermark) {
 
-        pkt = m_packetQueue->front();
+        m_paused = false;
 
-        m_packetQueue->pop_front();
+        m_pausedTime += std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - m_pausedSince).count();
 
-        return true;
+        m_drainedCondition.notify_all();
     }
-
-    return false;
 }
 
 /**
- * @brief Receiver::numPackets
- * @return
+ * @brief Receiver::waitPush
+ * @param queued
+ * @return false if canceled before the packet was queued
+ *
+ * Lots of small packets filled the queue, blocks until the client
+ * thread fetched one.
  */
 
-uint32_t Receiver::numPackets()
+bool Receiver::waitPush(QueuedPacket &queued)
 {
-    MutexLocker lock(m_packetQueue);
+    std::unique_lock<std::mutex> lock(m_flowMutex);
+
+    for (;;) {
+
+        m_queueFull = true;
+
+        // a fetch racing the flag either sees it or left a free cell
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_packetQueue.push(std::move(queued))) {
+
+            m_queueFull = false;
+
+            return true;
+        }
 
-    return m_packetQueue->size();
+        if (canceled()) {
+
+            m_queueFull = false;
+
+            return false;
+        }
+
+        notify();
+
+        m_drainedCondition.wait(lock, [this] () {
+
+            return !m_queueFull || canceled();
+        });
+    }
 }
 
 /**
@@ -1934,9 +3572,19 @@ uint32_t Receiver::numPackets()
 
 void Receiver::notify()
 {
-    std::unique_lock<std::mutex> lock(m_waitMutex);
+    m_signaled = true;
+
+    // only take the mutex if the client thread waits, the receiver
+    // thread notifies once per packet
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    m_waitCondition.notify_all();
+    if (m_waiting.load(std::memory_order_relaxed)) {
+
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+
+        m_waitCondition.notify_all();
+    }
 }
 
 /**
@@ -1959,14 +3607,30 @@ void Receiver::run()
             continue;
         }
 
-        if (m_client->status() >= Client::Secure &&
-            m_client->readable(1000) > 0) {
+        // leave the data in the socket while the client thread is
+        // behind, tcp flow control then holds back the server
+
+        if (!waitDrained(1000)) {
+
+            continue;
+        }
+
+        if (m_client->status() >= Client::Secure) {
 
             Packet pkt;
 
-            int32_t res = recvPacket(pkt);
+            int32_t res = readPacket(pkt);
+
+            if (res == 0) {
+
+                // all buffered packets are out, wait for more data
+
+                m_client->readable(1000);
 
-            if (res <= 0) {
+                continue;
+            }
+
+            if (res < 0) {
 
                 m_client->disconnect(false);
 
@@ -1974,10 +3638,54 @@ void Receiver::run()
             }
             else {
 
-                {
-                    MutexLocker lock(m_packetQueue);
+                // small bodies left in the receive buffer keep all of it
+                // alive, the first packet sharing it is charged for the
+                // whole buffer, so a queue of tiny packets can't pin
+                // lots of mostly unused buffers
+
+                QueuedPacket queued;
+
+                queued.bytes = sizeof(Packet::Head);
+
+                if (pkt.body() == m_buffer) {
+
+                    queued.bytes += m_bufferCharged ? 0 : m_buffer->size();
+
+                    m_bufferCharged = true;
+                }
+                else {
+
+                    queued.bytes += pkt.bodySize();
+                }
+
+                queued.packet = std::move(pkt);
+
+                // count the bytes before the packet becomes visible,
+                // so that the client thread never subtracts them first
+
+                uint32_t queuedBytes = m_queuedBytes += queued.bytes;
+
+                if (!m_packetQueue.push(std::move(queued)) && !waitPush(queued)) {
+
+                    // canceled, the packet is dropped
+
+                    m_queuedBytes -= queued.bytes;
+
+                    continue;
+                }
+
+                if (!m_paused && queuedBytes >= m_highWatermark) {
+
+                    MutexLocker lock(m_flowMutex);
+
+                    if (!m_paused && m_queuedBytes >= m_highWatermark) {
 
-                    m_packetQueue->push_back(pkt);
+                        m_paused = true;
+
+                        m_pausedSince = std::chrono::steady_clock::now();
+
+                        m_numPauses++;
+                    }
                 }
 
                 notify();
@@ -1987,58 +3695,261 @@ void Receiver::run()
 }
 
 /**
- * @brief Receiver::recvPacket
+ * @brief Receiver::readPacket
  * @param pkt
- * @return
+ * @return 1 if a packet was read, 0 if it would block, -1 on failure
+ *
+ * Never blocks. Packets are split off a buffer that takes as much as
+ * gnutls has per read, so a record carrying many small packets costs a
+ * single read. Large bodies are read into their buffer directly. A
+ * packet read in part is continued by the next call.
  */
 
-uint32_t Receiver::recvPacket(Packet &pkt)
+int32_t Receiver::readPacket(Packet &pkt)
 {
-    uint32_t s = 0;
+    const uint32_t headSize = sizeof(Packet::Head);
 
-    uint32_t r = m_client->recv((uint8_t*)&pkt.head(), sizeof(Packet::Head));
+    for (;;) {
 
-    if (r == 0) {
+        if (m_readOffset < headSize) {
 
-        // connection closed
+            m_readOffset += take((uint8_t*)&m_readPacket.head() + m_readOffset, headSize - m_readOffset);
 
-        return 0;
-    }
+            if (m_readOffset == headSize && m_readPacket.bodySize() > 0) {
 
-    if (r < sizeof(Packet::Head)) {
+                m_readBody = bodyBuffer(m_readPacket, m_readBodyOffset);
 
-        return -1;
-    }
+                if (!m_readBody) {
 
-    s += r;
+                    return -1;
+                }
 
-    if (pkt.bodySize() > 0) {
+                if (m_readBody == m_buffer) {
 
-        if (pkt.bodySize() > MAX_PACKET_BODY) {
+                    m_readOffset += m_readPacket.bodySize();
 
-            return -1;
+                    m_bufferBegin += m_readPacket.bodySize();
+                }
+            }
         }
 
-        MemoryBuffer$ body = MemoryBuffer::create(nullptr, pkt.bodySize());
+        if (m_readOffset >= headSize) {
 
-        if (!body) {
+            uint32_t size = headSize + m_readPacket.bodySize();
 
-            return -1;
+            if (m_readOffset < size) {
+
+                uint8_t *data = m_readBody->data() + m_readBodyOffset + m_readOffset - headSize;
+
+                if (m_bufferBegin == m_bufferEnd && size - m_readOffset >= RECEIVE_DIRECT_SIZE) {
+
+                    // saves copying through the buffer
+
+                    int32_t r = m_client->recvSome(data, size - m_readOffset);
+
+                    if (r <= 0) {
+
+                        return r;
+                    }
+
+                    m_readOffset += r;
+
+                    continue;
+                }
+
+                m_readOffset += take(data, size - m_readOffset);
+            }
+
+            if (m_readOffset == size) {
+
+                if (m_readBody) {
+
+                    m_readPacket.setBody(m_readBody, m_readPacket.bodySize(), m_readBodyOffset);
+                }
+
+                pkt = std::move(m_readPacket);
+
+                m_readPacket = Packet();
+
+                m_readOffset = 0;
+
+                m_readBody = nullptr;
+
+                m_readBodyOffset = 0;
+
+                m_numReadPackets++;
+
+                return 1;
+            }
+        }
+
+        // the buffer ran dry
+
+        int32_t r = fill();
+
+        if (r <= 0) {
+
+            return r;
         }
+    }
+}
 
-        r = m_client->recv(body->data(), pkt.bodySize());
+/**
+ * @brief Receiver::fill
+ * @return the bytes buffered, 0 if it would block, -1 on failure
+ *
+ * Called once the buffer is empty. Reads the socket once, then takes
+ * what gnutls still has pending from the records it read.
+ */
+
+int32_t Receiver::fill()
+{
+    if (!m_buffer || m_buffer.use_count() > 1) {
 
-        if (r < pkt.bodySize()) {
+        // packets still refer to the old buffer
+
+        BufferPool$ pool = BufferPool::packetPool(RECEIVE_BUFFER_SIZE);
+
+        m_buffer = pool ? pool->lease() : nullptr;
+
+        if (!m_buffer) {
 
             return -1;
         }
+    }
 
-        pkt.setBody(body);
+    m_bufferBegin = 0;
 
-        s += r;
+    m_bufferEnd = 0;
+
+    // no queued packet refers to the buffer anymore
+
+    m_bufferCharged = false;
+
+    int32_t r = m_client->recvSome(m_buffer->data(), m_buffer->size());
+
+    if (r <= 0) {
+
+        return r;
     }
 
-    return s;
+    m_bufferEnd = r;
+
+    while (m_bufferEnd < m_buffer->size() &&
+           gnutls_record_check_pending((gnutls_session_t)m_client->m_session) > 0) {
+
+        r = m_client->recvSome(m_buffer->data() + m_bufferEnd, m_buffer->size() - m_bufferEnd);
+
+        if (r <= 0) {
+
+            // a failure shows up again on the next read
+
+            break;
+        }
+
+        m_bufferEnd += r;
+    }
+
+    m_numReads++;
+
+    return m_bufferEnd;
+}
+
+/**
+ * @brief Receiver::take
+ * @param data
+ * @param size
+ * @return the bytes taken from the buffer
+ */
+
+uint32_t Receiver::take(uint8_t *data, uint32_t size)
+{
+    uint32_t n = std::min(size, m_bufferEnd - m_bufferBegin);
+
+    if (n > 0) {
+
+        memcpy(data, m_buffer->data() + m_bufferBegin, n);
+
+        m_bufferBegin += n;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Receiver::resetRead
+ *
+ * Drops a packet read in part along with the buffered data.
+ */
+
+void Receiver::resetRead()
+{
+    m_readPacket = Packet();
+
+    m_readOffset = 0;
+
+    m_readBody = nullptr;
+
+    m_readBodyOffset = 0;
+
+    m_bufferBegin = 0;
+
+    m_bufferEnd = 0;
+}
+
+/**
+ * @brief Receiver::bodyBuffer
+ * @param pkt
+ * @param offset
+ * @return
+ */
+
+MemoryBuffer$ Receiver::bodyBuffer(const Packet &pkt, uint32_t &offset)
+{
+    // the server never exceeds the body size proposed at login
+
+    uint32_t maxBodySize = m_client->preferredPacketBodySize();
+
+    if (maxBodySize < MAX_PACKET_BODY) {
+
+        maxBodySize = MAX_PACKET_BODY;
+    }
+
+    if (pkt.bodySize() > maxBodySize) {
+
+        return nullptr;
+    }
+
+    // receive the body straight into the buffer of its stream
+    // receiver if there is one already, into a pooled buffer
+    // which is handed over to the client thread otherwise
+
+    offset = 0;
+
+    StreamReceiver$ receiver = m_client->streamReceiver(pkt.streamId());
+
+    MemoryBuffer$ buffer = receiver ? receiver->packetBuffer(pkt, offset) : nullptr;
+
+    if (buffer) {
+
+        return buffer;
+    }
+
+    // a body that arrived in one piece stays in the receive buffer,
+    // the packet shares it instead of leasing a buffer of its own
+
+    if (m_buffer && m_bufferEnd - m_bufferBegin >= pkt.bodySize()) {
+
+        offset = m_bufferBegin;
+
+        return m_buffer;
+    }
+
+    offset = 0;
+
+    BufferPool$ pool = BufferPool::packetPool(pkt.bodySize());
+
+    return pool ? pool->lease() : nullptr;
 }
 
 // ============================================================ //
@@ -0,0 +1,690 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/clientruntime.h"
+#include "Zway/client.h"
+
+#include <chrono>
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace Zway {
+
+const uint32_t RUNTIME_POLL_INTERVAL = 50;
+
+// ============================================================ //
+
+/**
+ * @brief threadCpuTime
+ * @return microseconds of cpu time used by the calling thread
+ */
+
+static uint64_t threadCpuTime()
+{
+#if defined _WIN32
+
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+
+        return 0;
+    }
+
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+    return (k + u) / 10;
+
+#else
+
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+
+        return 0;
+    }
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+#endif
+}
+
+/**
+ * @brief threadStackSize
+ * @return bytes reserved for the stack of a new thread
+ */
+
+static uint64_t threadStackSize()
+{
+#if defined _WIN32
+
+    return 1 << 20;
+
+#else
+
+    pthread_attr_t attr;
+
+    size_t size = 0;
+
+    if (pthread_attr_init(&attr) == 0) {
+
+        pthread_attr_getstacksize(&attr, &size);
+
+        pthread_attr_destroy(&attr);
+    }
+
+    return size;
+
+#endif
+}
+
+/**
+ * @brief ClientRuntime::create
+ * @param numIoThreads threads running the client steps, 0 picks a default
+ * @param numWorkers threads handling incoming requests, 0 picks a default
+ * @return
+ */
+
+ClientRuntime$ ClientRuntime::create(uint32_t numIoThreads, uint32_t numWorkers)
+{
+    ClientRuntime$ runtime(new ClientRuntime(numIoThreads, numWorkers));
+
+    if (!runtime->start()) {
+
+        return nullptr;
+    }
+
+    return runtime;
+}
+
+/**
+ * @brief ClientRuntime::ClientRuntime
+ * @param numIoThreads
+ * @param numWorkers
+ */
+
+ClientRuntime::ClientRuntime(uint32_t numIoThreads, uint32_t numWorkers)
+    : m_numIoThreads(numIoThreads),
+      m_numWorkers(numWorkers),
+      m_running(false),
+      m_pollFd(-1),
+      m_wakeFd(-1),
+      m_nextId(0),
+      m_pollDeadline(0),
+      m_numSteps(0),
+      m_stepTime(0)
+{
+
+}
+
+/**
+ * @brief ClientRuntime::~ClientRuntime
+ */
+
+ClientRuntime::~ClientRuntime()
+{
+    stop();
+}
+
+/**
+ * @brief ClientRuntime::start
+ * @return
+ */
+
+bool ClientRuntime::start()
+{
+    if (m_running) {
+
+        return false;
+    }
+
+#if defined __linux__
+
+    m_pollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_pollFd == -1) {
+
+        return false;
+    }
+
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (m_wakeFd == -1) {
+
+        ::close(m_pollFd);
+
+        m_pollFd = -1;
+
+        return false;
+    }
+
+    // id 0 is never given to a client
+
+    struct epoll_event ev = {};
+
+    ev.events = EPOLLIN;
+
+    ev.data.u64 = 0;
+
+    epoll_ctl(m_pollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+#endif
+
+    m_running = true;
+
+    m_io.start(m_numIoThreads);
+
+    m_workers.start(m_numWorkers);
+
+    m_poller = std::thread(&ClientRuntime::run, this);
+
+    return true;
+}
+
+/**
+ * @brief ClientRuntime::stop
+ *
+ * Clients still added are dropped without being closed.
+ */
+
+void ClientRuntime::stop()
+{
+    if (!m_running.exchange(false)) {
+
+        return;
+    }
+
+    interrupt();
+
+    if (m_poller.joinable()) {
+
+        m_poller.join();
+    }
+
+    m_io.stop();
+
+    m_workers.stop();
+
+    {
+        MutexLocker locker(m_mutex);
+
+        m_slots.clear();
+    }
+
+#if defined __linux__
+
+    ::close(m_wakeFd);
+
+    ::close(m_pollFd);
+
+#endif
+
+    m_pollFd = -1;
+
+    m_wakeFd = -1;
+}
+
+/**
+ * @brief ClientRuntime::add
+ * @param client
+ * @return
+ */
+
+bool ClientRuntime::add(Client$ client)
+{
+    if (!client || !m_running) {
+
+        return false;
+    }
+
+    uint32_t id;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        do {
+
+            id = ++m_nextId;
+        }
+        while (!id || m_slots.count(id));
+
+        Slot$ slot = std::make_shared<Slot>();
+
+        slot->client = client;
+
+        slot->scheduled = false;
+
+        slot->removed = false;
+
+        m_slots[id] = slot;
+    }
+
+    client->m_runtimeId = id;
+
+    schedule(id);
+
+    return true;
+}
+
+/**
+ * @brief ClientRuntime::remove
+ * @param id
+ * @return the client, released by the caller once it is done with it
+ *
+ * Waits for a step of the client in progress.
+ */
+
+Client$ ClientRuntime::remove(uint32_t id)
+{
+    Slot$ slot;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        auto it = m_slots.find(id);
+
+        if (it == m_slots.end()) {
+
+            return nullptr;
+        }
+
+        slot = it->second;
+
+        m_slots.erase(it);
+    }
+
+    {
+        MutexLocker locker(m_timerMutex);
+
+        m_timers.cancel(id);
+    }
+
+    MutexLocker locker(slot->stepMutex);
+
+    slot->removed = true;
+
+    Client$ client = slot->client;
+
+    slot->client = nullptr;
+
+    return client;
+}
+
+/**
+ * @brief ClientRuntime::schedule
+ * @param id
+ *
+ * Runs a step of the client soon, once even if scheduled repeatedly.
+ */
+
+void ClientRuntime::schedule(uint32_t id)
+{
+    Slot$ slot;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        auto it = m_slots.find(id);
+
+        if (it == m_slots.end()) {
+
+            return;
+        }
+
+        slot = it->second;
+    }
+
+    if (!slot->scheduled.exchange(true)) {
+
+        // keyed by client, so its steps never overlap
+
+        m_io.post(id, [this, slot, id] () {
+
+            step(slot, id);
+        });
+    }
+}
+
+/**
+ * @brief ClientRuntime::watch
+ * @param id
+ * @param socket
+ * @return
+ */
+
+bool ClientRuntime::watch(uint32_t id, intptr_t socket)
+{
+#if defined __linux__
+
+    struct epoll_event ev = {};
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+    ev.data.u64 = id;
+
+    return epoll_ctl(m_pollFd, EPOLL_CTL_ADD, socket, &ev) == 0;
+
+#else
+
+    return true;
+
+#endif
+}
+
+/**
+ * @brief ClientRuntime::unwatch
+ * @param socket
+ */
+
+void ClientRuntime::unwatch(intptr_t socket)
+{
+#if defined __linux__
+
+    epoll_ctl(m_pollFd, EPOLL_CTL_DEL, socket, nullptr);
+
+#endif
+}
+
+/**
+ * @brief ClientRuntime::workers
+ * @return
+ */
+
+Executor &ClientRuntime::workers()
+{
+    return m_workers;
+}
+
+/**
+ * @brief ClientRuntime::dispatchKey
+ * @param id
+ * @param key dispatch key within the client
+ * @return
+ *
+ * Keys of different clients rarely meet, if they do, their requests
+ * are merely handled one after another.
+ */
+
+uint64_t ClientRuntime::dispatchKey(uint32_t id, uint64_t key)
+{
+    return key ^ (id * 0x9E3779B97F4A7C15ull);
+}
+
+/**
+ * @brief ClientRuntime::numClients
+ * @return
+ */
+
+uint32_t ClientRuntime::numClients()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_slots.size();
+}
+
+/**
+ * @brief ClientRuntime::stats
+ * @return
+ *
+ * Compares the threads of the runtime to those the clients would have
+ * started on their own: a client, sender and receiver thread and the
+ * request workers of each. The stack given is address space reserved
+ * for the threads not started, not resident memory, which depends on
+ * how deep their stacks got. The cpu time is spent in the client steps.
+ */
+
+UBJ::Object ClientRuntime::stats()
+{
+    uint32_t numClients = this->numClients();
+
+    uint32_t numThreads = m_io.numThreads() + m_workers.numThreads() + 1;
+
+    uint32_t threadsPerClient = 3 + MAX_CLIENT_WORKERS;
+
+    uint32_t dedicatedThreads = numClients * threadsPerClient;
+
+    uint32_t threadsSaved = dedicatedThreads > numThreads ? dedicatedThreads - numThreads : 0;
+
+    uint64_t stackSize = threadStackSize();
+
+    uint64_t stepTime = m_stepTime;
+
+    return UBJ_OBJ(
+                "clients"          << numClients <<
+                "threads"          << numThreads <<
+                "dedicatedThreads" << dedicatedThreads <<
+                "threadsSaved"     << threadsSaved <<
+                "stackSize"        << stackSize <<
+                "stackReserveSaved" << threadsSaved * stackSize <<
+                "stackReserveSavedPerClient" << (numClients ? threadsSaved * stackSize / numClients : 0) <<
+                "steps"            << (uint64_t)m_numSteps <<
+                "cpuTime"          << stepTime <<
+                "cpuTimePerClient" << (numClients ? stepTime / numClients : 0));
+}
+
+/**
+ * @brief ClientRuntime::run
+ *
+ * The poller thread.
+ */
+
+void ClientRuntime::run()
+{
+    std::vector<uint32_t> ready;
+
+    while (m_running) {
+
+        // wait until the next deadline at most
+
+        int32_t timeout = -1;
+
+        {
+            MutexLocker locker(m_timerMutex);
+
+            m_pollDeadline = m_timers.nextDeadline();
+
+            if (m_pollDeadline) {
+
+                uint64_t now = TimingWheel::now();
+
+                timeout = m_pollDeadline > now ? m_pollDeadline - now : 0;
+            }
+            else {
+
+                m_pollDeadline = (uint64_t)-1;
+            }
+        }
+
+#if defined __linux__
+
+        struct epoll_event events[64];
+
+        int32_t n = epoll_wait(m_pollFd, events, 64, timeout);
+
+        for (int32_t i=0; i<n; ++i) {
+
+            if (events[i].data.u64 == 0) {
+
+                uint64_t value;
+
+                if (::read(m_wakeFd, &value, sizeof(value))) {
+
+                }
+
+                continue;
+            }
+
+            schedule(events[i].data.u64);
+        }
+
+#else
+
+        if (timeout < 0 || timeout > (int32_t)RUNTIME_POLL_INTERVAL) {
+
+            timeout = RUNTIME_POLL_INTERVAL;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+
+        {
+            MutexLocker locker(m_mutex);
+
+            for (auto &it : m_slots) {
+
+                Client::Status status = it.second->client->status();
+
+                if (status >= Client::Connecting) {
+
+                    ready.push_back(it.first);
+                }
+            }
+        }
+
+#endif
+
+        {
+            MutexLocker locker(m_timerMutex);
+
+            m_pollDeadline = 0;
+
+            m_timers.advance(TimingWheel::now(), [&ready] (uint32_t id) {
+
+                ready.push_back(id);
+            });
+        }
+
+        for (auto id : ready) {
+
+            schedule(id);
+        }
+
+        ready.clear();
+    }
+}
+
+/**
+ * @brief ClientRuntime::step
+ * @param slot
+ * @param id
+ */
+
+void ClientRuntime::step(Slot$ slot, uint32_t id)
+{
+    // events arriving from now on schedule another step
+
+    slot->scheduled = false;
+
+    uint32_t ms;
+
+    {
+        MutexLocker locker(slot->stepMutex);
+
+        if (slot->removed) {
+
+            return;
+        }
+
+        uint64_t t = threadCpuTime();
+
+        ms = slot->client->step();
+
+        m_stepTime += threadCpuTime() - t;
+
+        m_numSteps++;
+    }
+
+    if (ms == 0) {
+
+        schedule(id);
+    }
+    else {
+
+        setTimer(id, ms);
+    }
+}
+
+/**
+ * @brief ClientRuntime::setTimer
+ * @param id
+ * @param ms
+ */
+
+void ClientRuntime::setTimer(uint32_t id, uint32_t ms)
+{
+    MutexLocker locker(m_timerMutex);
+
+    m_timers.cancel(id);
+
+    if (ms == REACTOR_INFINITE) {
+
+        return;
+    }
+
+    uint64_t deadline = TimingWheel::now() + ms;
+
+    m_timers.add(id, deadline);
+
+    // the poller sleeps past the new deadline, while it is
+    // not sleeping it picks up the deadline by itself
+
+    if (m_pollDeadline && deadline < m_pollDeadline) {
+
+        interrupt();
+    }
+}
+
+/**
+ * @brief ClientRuntime::interrupt
+ */
+
+void ClientRuntime::interrupt()
+{
+#if defined __linux__
+
+    uint64_t one = 1;
+
+    if (::write(m_wakeFd, &one, sizeof(one))) {
+
+    }
+
+#endif
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,428 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/connector.h"
+#include "Zway/reactor.h"
+
+#if defined _WIN32
+#include <winsock2.h>
+#else
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace Zway {
+
+const uint32_t CONNECT_ATTEMPT_DELAY = 250;
+
+// ============================================================ //
+
+/**
+ * @brief Connector::Connector
+ */
+
+Connector::Connector()
+    : m_next(0)
+{
+
+}
+
+/**
+ * @brief Connector::~Connector
+ */
+
+Connector::~Connector()
+{
+    cancel();
+}
+
+/**
+ * @brief Connector::start
+ * @param addresses in the order to try them
+ * @param watch registers the sockets of the attempts with a poller
+ *
+ * Attempts are started by poll().
+ */
+
+void Connector::start(const Resolver::AddressList &addresses, WatchCallback watch)
+{
+    cancel();
+
+    m_addresses = addresses;
+
+    m_watch = watch;
+
+    m_nextAttempt = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Connector::poll
+ * @param socket receives the connected socket
+ * @return 1 if connected, 0 if still connecting, -1 if all attempts failed
+ *
+ * Never blocks. The connected socket stays registered with the watch
+ * callback, it belongs to the caller now.
+ */
+
+int32_t Connector::poll(intptr_t &socket)
+{
+    if (!m_sockets.empty()) {
+
+        std::vector<intptr_t> done;
+
+#if defined _WIN32
+
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+
+        fd_set ws;
+        FD_ZERO(&ws);
+
+        fd_set es;
+        FD_ZERO(&es);
+
+        for (auto s : m_sockets) {
+
+            FD_SET((SOCKET)s, &ws);
+
+            FD_SET((SOCKET)s, &es);
+        }
+
+        if (select(0, nullptr, &ws, &es, &tv) > 0) {
+
+            for (auto s : m_sockets) {
+
+                if (FD_ISSET((SOCKET)s, &ws) || FD_ISSET((SOCKET)s, &es)) {
+
+                    done.push_back(s);
+                }
+            }
+        }
+
+#else
+
+        // poll instead of select, a process running many
+        // clients may well have descriptors above FD_SETSIZE
+
+        std::vector<struct pollfd> pfds(m_sockets.size());
+
+        for (size_t i=0; i<m_sockets.size(); ++i) {
+
+            pfds[i].fd = m_sockets[i];
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+        }
+
+        if (::poll(pfds.data(), pfds.size(), 0) > 0) {
+
+            for (auto &pfd : pfds) {
+
+                if (pfd.revents) {
+
+                    done.push_back(pfd.fd);
+                }
+            }
+        }
+
+#endif
+
+        for (auto s : done) {
+
+            int32_t res = -1;
+
+#if defined _WIN32
+
+            int32_t len = sizeof(int32_t);
+
+            getsockopt((SOCKET)s, SOL_SOCKET, SO_ERROR, (char*)&res, &len);
+
+#else
+
+            socklen_t len = sizeof(int32_t);
+
+            getsockopt(s, SOL_SOCKET, SO_ERROR, &res, &len);
+
+#endif
+
+            for (auto it = m_sockets.begin(); it != m_sockets.end(); ++it) {
+
+                if (*it == s) {
+
+                    m_sockets.erase(it);
+
+                    break;
+                }
+            }
+
+            if (res == 0) {
+
+                // the winner keeps its registration
+
+                socket = s;
+
+                cancel();
+
+                return 1;
+            }
+
+            close(s);
+        }
+    }
+
+    // start the next attempt if none is in flight or
+    // the ones in flight take too long
+
+    auto now = std::chrono::steady_clock::now();
+
+    while (m_next < m_addresses.size() && (m_sockets.empty() || now >= m_nextAttempt)) {
+
+        if (attempt()) {
+
+            m_nextAttempt = now + std::chrono::milliseconds(CONNECT_ATTEMPT_DELAY);
+
+            break;
+        }
+    }
+
+    return m_sockets.empty() ? -1 : 0;
+}
+
+/**
+ * @brief Connector::timeout
+ * @return ms until the next attempt is due
+ */
+
+uint32_t Connector::timeout()
+{
+    if (m_next >= m_addresses.size()) {
+
+        return REACTOR_INFINITE;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now >= m_nextAttempt) {
+
+        return 0;
+    }
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(m_nextAttempt - now).count() + 1;
+}
+
+/**
+ * @brief Connector::wait
+ * @param ms
+ *
+ * Waits for an attempt in flight to finish, for callers
+ * without a poller of their own.
+ */
+
+void Connector::wait(uint32_t ms)
+{
+    if (m_sockets.empty()) {
+
+        return;
+    }
+
+#if defined _WIN32
+
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+
+    fd_set ws;
+    FD_ZERO(&ws);
+
+    fd_set es;
+    FD_ZERO(&es);
+
+    for (auto s : m_sockets) {
+
+        FD_SET((SOCKET)s, &ws);
+
+        FD_SET((SOCKET)s, &es);
+    }
+
+    select(0, nullptr, &ws, &es, &tv);
+
+#else
+
+    std::vector<struct pollfd> pfds(m_sockets.size());
+
+    for (size_t i=0; i<m_sockets.size(); ++i) {
+
+        pfds[i].fd = m_sockets[i];
+        pfds[i].events = POLLOUT;
+        pfds[i].revents = 0;
+    }
+
+    ::poll(pfds.data(), pfds.size(), ms);
+
+#endif
+}
+
+/**
+ * @brief Connector::cancel
+ *
+ * Drops the attempts in flight and the addresses not tried yet.
+ */
+
+void Connector::cancel()
+{
+    for (auto s : m_sockets) {
+
+        close(s);
+    }
+
+    m_sockets.clear();
+
+    m_addresses.clear();
+
+    m_next = 0;
+
+    m_watch = nullptr;
+}
+
+/**
+ * @brief Connector::active
+ * @return
+ */
+
+bool Connector::active()
+{
+    return !m_sockets.empty() || m_next < m_addresses.size();
+}
+
+/**
+ * @brief Connector::attempt
+ * @return false if connecting to the next address failed right away
+ */
+
+bool Connector::attempt()
+{
+    const std::string &address = m_addresses[m_next++];
+
+    const struct sockaddr *addr = (const struct sockaddr*)address.data();
+
+#if defined _WIN32
+
+    SOCKET s = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+
+    if (s == INVALID_SOCKET) {
+
+        return false;
+    }
+
+    u_long on = 1;
+
+    ioctlsocket(s, FIONBIO, &on);
+
+#else
+
+    int32_t s = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+
+    if (s == -1) {
+
+        return false;
+    }
+
+    int32_t flags = fcntl(s, F_GETFL, 0);
+
+    fcntl(s, F_SETFL, flags | O_NONBLOCK);
+
+#endif
+
+    // register the socket before connecting, so that the
+    // connection becoming writable is not missed
+
+    if (m_watch && !m_watch(s, true)) {
+
+#if defined _WIN32
+
+        closesocket(s);
+
+#else
+
+        ::close(s);
+
+#endif
+
+        return false;
+    }
+
+    int32_t res = ::connect(s, addr, address.size());
+
+#if defined _WIN32
+
+    if (res && WSAGetLastError() != WSAEWOULDBLOCK) {
+
+#else
+
+    if (res && errno != EINPROGRESS) {
+
+#endif
+
+        close(s);
+
+        return false;
+    }
+
+    m_sockets.push_back(s);
+
+    return true;
+}
+
+/**
+ * @brief Connector::close
+ * @param socket
+ */
+
+void Connector::close(intptr_t socket)
+{
+    if (m_watch) {
+
+        m_watch(socket, false);
+    }
+
+#if defined _WIN32
+
+    closesocket((SOCKET)socket);
+
+#else
+
+    ::close(socket);
+
+#endif
+}
+
+// ============================================================ //
+
+}
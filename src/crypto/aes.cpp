@@ -111,6 +111,47 @@ void AES::setCtr(MemoryBuffer$ ctr)
     }
 }
 
+/**
+ * @brief AES::setCtr
+ * @param ctr
+ * @param offset
+ * @return
+ *
+ * Sets the counter to where it is after encrypting offset bytes
+ * from ctr on, offset has to be a multiple of the block size.
+ */
+
+bool AES::setCtr(MemoryBuffer$ ctr, uint64_t offset)
+{
+    if (!ctr || ctr->size() < AES_BLOCK_SIZE || offset % AES_BLOCK_SIZE) {
+
+        return false;
+    }
+
+    setCtr(ctr);
+
+    // add the number of blocks to the big endian counter
+
+    uint8_t *c = ((AES_CTR_CTX*)m_ctx)->ctr;
+
+    uint64_t blocks = offset / AES_BLOCK_SIZE;
+
+    uint32_t carry = 0;
+
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0 && (blocks || carry); --i) {
+
+        uint32_t sum = c[i] + (uint32_t)(blocks & 0xff) + carry;
+
+        c[i] = sum & 0xff;
+
+        carry = sum >> 8;
+
+        blocks >>= 8;
+    }
+
+    return true;
+}
+
 /**
  * @brief AES::encrypt
  * @param src
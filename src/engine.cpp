@@ -28,11 +28,28 @@
 #include "Zway/ubjreceiver.h"
 #include "Zway/ubjsender.h"
 #include "Zway/memorybuffer.h"
+#include "Zway/crypto/crypto.h"
 
 namespace Zway {
 
+const uint32_t MAX_CONTROL_BATCH = 128;
+
 // ============================================================ //
 
+/**
+ * @brief Engine::Engine
+ */
+
+Engine::Engine()
+    : m_preferredPacketBodySize(MAX_PACKET_BODY),
+      m_packetBodySize(MAX_PACKET_BODY),
+      m_compression(false),
+      m_batching(false),
+      m_streamEpoch(0)
+{
+
+}
+
 /**
  * @brief Engine::~Engine
  */
@@ -48,40 +65,63 @@ Engine::~Engine()
 
 void Engine::process()
 {
-    std::list<Request$> remove;
+    std::list<uint32_t> expired;
 
     {
-        MutexLocker locker(m_requests);
+        MutexLocker locker(m_timeouts);
+
+        m_timeouts->advance(TimingWheel::now(), [&expired] (uint32_t id) {
+
+            expired.push_back(id);
+        });
+    }
 
-        if (!m_requests->empty()) {
+    if (expired.empty()) {
 
-            uint64_t t = time(nullptr);
+        return;
+    }
 
-            for (auto &it : *m_requests) {
+    for (auto id : expired) {
 
-                Request$ &req = it.second;
+        Request$ request = m_requests.take(id);
 
-                if (req->checkTimeout(t)) {
+        if (request) {
 
-                    remove.push_back(req);
-                }
-            }
+            request->setStatus(Request::Timeout);
+
+            processRequestTimeout(request);
         }
     }
+}
+
+/**
+ * @brief Engine::nextTimeout
+ * @param max
+ * @return
+ *
+ * Returns the time in ms until the next request may time out, but
+ * no more than max, for the caller to sleep until then.
+ */
+
+uint32_t Engine::nextTimeout(uint32_t max)
+{
+    MutexLocker locker(m_timeouts);
+
+    uint64_t deadline = m_timeouts->nextDeadline();
 
-    for (auto &it : remove) {
+    if (!deadline) {
 
-        processRequestTimeout(it);
+        return max;
     }
 
-    {
-        MutexLocker locker(m_requests);
+    uint64_t now = TimingWheel::now();
 
-        for (auto &it : remove) {
+    if (deadline <= now) {
 
-            m_requests->erase(it->id());
-        }
+        return 0;
     }
+
+    return deadline - now < max ? deadline - now : max;
 }
 
 /**
@@ -90,19 +130,19 @@ void Engine::process()
 
 void Engine::finish()
 {
+    m_requests.clear();
+
     {
-        MutexLocker locker(m_requests);
+        MutexLocker locker(m_timeouts);
 
-        m_requests->clear();
+        m_timeouts->clear();
     }
 
     // cancel pending stream senders
 
-    {
-        MutexLocker locker(m_streamSenders);
+    m_requestSenders.clear();
 
-        m_streamSenders->clear();
-    }
+    m_resourceSenders.clear();
 
     // cancel pending stream receivers
 
@@ -131,10 +171,27 @@ bool Engine::addStreamSender(StreamSender$ sender)
         return false;
     }
 
-    {
-        MutexLocker locker(m_streamSenders);
+    // streams must not exceed the body size of the connection
+
+    uint32_t bodySize = packetBodySize(sender->type());
 
-        m_streamSenders->push_back(sender);
+    if (sender->bodySize() > bodySize) {
+
+        if (!sender->setBodySize(bodySize)) {
+
+            return false;
+        }
+    }
+
+    sender->m_epoch = m_streamEpoch;
+
+    if (sender->type() == Packet::Request) {
+
+        m_requestSenders.push(sender);
+    }
+    else {
+
+        m_resourceSenders.push(sender);
     }
 
     return true;
@@ -150,7 +207,7 @@ bool Engine::addStreamSender(StreamSender$ sender)
 
 bool Engine::addUbjSender(uint32_t id, Packet::StreamType type, const UBJ::Value &value)
 {
-    return addStreamSender(UbjSender::create(id, type, value));
+    return addStreamSender(UbjSender::create(id, type, value, nullptr, compression()));
 }
 
 /**
@@ -174,21 +231,42 @@ bool Engine::postRequest(Request$ request)
     }
 
 
-    StreamSender$ sender = request->start();
+    // register before sending, the response may come back
+    // before addStreamSender returns
 
-    if (!sender) {
+    if (!m_requests.insert(request)) {
 
         return false;
     }
 
-    if (!addStreamSender(sender)) {
+    StreamSender$ sender = request->start(compression());
+
+    if (!sender) {
+
+        m_requests.erase(request->id());
 
         return false;
     }
 
-    MutexLocker locker(m_requests);
+    if (request->deadline()) {
+
+        MutexLocker locker(m_timeouts);
+
+        m_timeouts->add(request->id(), request->deadline());
+    }
+
+    if (!addStreamSender(sender)) {
+
+        {
+            MutexLocker locker(m_timeouts);
+
+            m_timeouts->cancel(request->id());
+        }
+
+        m_requests.erase(request->id());
 
-    (*m_requests)[request->id()] = request;
+        return false;
+    }
 
     return true;
 }
@@ -208,10 +286,7 @@ bool Engine::postRequestSuccess(uint32_t requestId, const UBJ::Object &head)
 
     data["status"] = 1;
 
-    return addUbjSender(
-                requestId,
-                Packet::Request,
-                data);
+    return postControl(data);
 }
 
 /**
@@ -224,9 +299,7 @@ bool Engine::postRequestSuccess(uint32_t requestId, const UBJ::Object &head)
 
 bool Engine::postRequestFailure(uint32_t requestId, uint32_t code, const std::string &msg)
 {
-    return addUbjSender(
-                requestId,
-                Packet::Request,
+    return postControl(
                 UBJ_OBJ(
                     "requestId" << requestId <<
                     "status"    << 0 <<
@@ -234,6 +307,82 @@ bool Engine::postRequestFailure(uint32_t requestId, uint32_t code, const std::st
                     "message"   << msg));
 }
 
+/**
+ * @brief Engine::postControl
+ * @param data
+ * @return
+ *
+ * Posts a small request or response. With batching enabled it waits
+ * in the control batch until flushControl() or until the batch is
+ * full, then all of them are sent as one stream.
+ */
+
+bool Engine::postControl(const UBJ::Object &data)
+{
+    if (!batching()) {
+
+        return addUbjSender(data["requestId"].toInt(), Packet::Request, data);
+    }
+
+    bool first = false;
+
+    bool full = false;
+
+    {
+        MutexLocker locker(m_controlBatch);
+
+        first = m_controlBatch->empty();
+
+        m_controlBatch->push_back(data);
+
+        full = m_controlBatch->size() >= MAX_CONTROL_BATCH;
+    }
+
+    if (full) {
+
+        return flushControl();
+    }
+
+    if (first) {
+
+        wake();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Engine::flushControl
+ * @return
+ *
+ * Sends the batched control objects, a single one goes out as is.
+ */
+
+bool Engine::flushControl()
+{
+    UBJ::Array batch;
+
+    {
+        MutexLocker locker(m_controlBatch);
+
+        if (m_controlBatch->empty()) {
+
+            return true;
+        }
+
+        batch.swap(*m_controlBatch);
+    }
+
+    if (batch.size() == 1) {
+
+        UBJ::Object data(batch.front());
+
+        return addUbjSender(data["requestId"].toInt(), Packet::Request, data);
+    }
+
+    return addUbjSender(Crypto::mkId(), Packet::Request, UBJ_OBJ("batch" << batch));
+}
+
 /**
  * @brief Engine::requestPending
  * @param type
@@ -243,109 +392,301 @@ bool Engine::postRequestFailure(uint32_t requestId, uint32_t code, const std::st
 
 bool Engine::requestPending(Request::Type type, uint32_t id)
 {
-    MutexLocker lock(m_requests);
+    return m_requests.pending(type, id);
+}
+
+/**
+ * @brief Engine::numPendingRequests
+ * @return
+ */
+
+uint32_t Engine::numPendingRequests()
+{
+    return m_requests.count();
+}
+
+/**
+ * @brief Engine::numPendingRequests
+ * @param type
+ * @return
+ */
+
+uint32_t Engine::numPendingRequests(Request::Type type)
+{
+    return m_requests.count(type);
+}
+
+/**
+ * @brief Engine::numStreamSenders
+ * @return
+ */
+
+uint32_t Engine::numStreamSenders()
+{
+    uint32_t res = 0;
 
-    if (id) {
+    res += m_requestSenders.size();
 
-        for (auto &it: *m_requests) {
+    res += m_resourceSenders.size();
 
-            if (it.second->type() == type && it.second->id() == id) {
+    return res;
+}
 
-                return true;
-            }
-        }
+/**
+ * @brief Engine::streamEpoch
+ * @return
+ *
+ * Advanced whenever the peer drops the streams in progress, stream
+ * senders and pushes only continue within the epoch they started in.
+ */
+
+uint32_t Engine::streamEpoch()
+{
+    return m_streamEpoch;
+}
+
+/**
+ * @brief Engine::dropStreams
+ *
+ * The queued stream senders belong to the thread sending packets, so
+ * they aren't touched here. They fail with an error once they come up,
+ * which releases whatever their callbacks hold.
+ */
+
+void Engine::dropStreams()
+{
+    m_streamEpoch++;
+}
+
+/**
+ * @brief Engine::sendPackets
+ * @param transport
+ * @return number of packets sent
+ *
+ * Runs one round of the stream senders and sends their packets on the
+ * transport, for engines that aren't driven by a Client.
+ */
+
+int32_t Engine::sendPackets(Transport$ transport)
+{
+    return processStreamSenders([transport] (Packet$ pkt) -> bool {
+
+        return transport->send(pkt);
+    });
+}
+
+/**
+ * @brief Engine::receivePacket
+ * @param transport
+ * @param ms
+ * @return false if no packet arrived within ms
+ */
+
+bool Engine::receivePacket(Transport$ transport, uint32_t ms)
+{
+    Packet pkt;
+
+    if (!transport->receive(pkt, ms)) {
+
+        return false;
     }
-    else {
 
-        for (auto &it: *m_requests) {
+    processIncomingPacket(pkt);
 
-            if (it.second->type() == type) {
+    return true;
+}
 
-                return true;
-            }
-        }
+/**
+ * @brief Engine::setPreferredPacketBodySize
+ * @param size
+ */
+
+void Engine::setPreferredPacketBodySize(uint32_t size)
+{
+    if (size < MIN_PACKET_BODY) {
+
+        size = MIN_PACKET_BODY;
     }
+    else
+    if (size > MAX_JUMBO_PACKET_BODY) {
 
-    return false;
+        size = MAX_JUMBO_PACKET_BODY;
+    }
+
+    // resource parts are encrypted one by one in ctr mode,
+    // keep them aligned to the cipher block size
+
+    size -= size % 16;
+
+    MutexLocker locker(m_preferredPacketBodySize);
+
+    m_preferredPacketBodySize = size;
 }
 
 /**
- * @brief Engine::numStreamSenders
+ * @brief Engine::preferredPacketBodySize
  * @return
  */
 
-uint32_t Engine::numStreamSenders()
+uint32_t Engine::preferredPacketBodySize()
 {
-    MutexLocker locker(m_streamSenders);
+    MutexLocker locker(m_preferredPacketBodySize);
 
-    return m_streamSenders->size();
+    return m_preferredPacketBodySize;
 }
 
 /**
- * @brief Engine::createStreamReceiver
- * @param pkt
+ * @brief Engine::setPacketBodySize
+ * @param size
+ */
+
+void Engine::setPacketBodySize(uint32_t size)
+{
+    if (size < MIN_PACKET_BODY) {
+
+        size = MIN_PACKET_BODY;
+    }
+    else
+    if (size > MAX_JUMBO_PACKET_BODY) {
+
+        size = MAX_JUMBO_PACKET_BODY;
+    }
+
+    size -= size % 16;
+
+    MutexLocker locker(m_packetBodySize);
+
+    m_packetBodySize = size;
+}
+
+/**
+ * @brief Engine::packetBodySize
+ * @param type
  * @return
  */
 
-StreamReceiver$ Engine::createStreamReceiver(const Packet &pkt)
+uint32_t Engine::packetBodySize(Packet::StreamType type)
 {
-    if (pkt.streamType() == Packet::Request) {
+    MutexLocker locker(m_packetBodySize);
 
-        // create request receiver
+    // request streams carry small ubj objects and
+    // never use more than the default body size
 
-        return UbjReceiver::create(pkt, [this] (UbjReceiver$ receiver, UBJ::Value &data) {
+    if (type == Packet::Request && m_packetBodySize > MAX_PACKET_BODY) {
+
+        return MAX_PACKET_BODY;
+    }
 
-            UBJ::Object head(data);
+    return m_packetBodySize;
+}
 
-            if (receiver->status() == StreamReceiver::Completed) {
+/**
+ * @brief Engine::setCompression
+ * @param compression
+ */
 
-                Request$ request;
+void Engine::setCompression(bool compression)
+{
+    MutexLocker locker(m_compression);
 
-                if (head.hasField("requestId")) {
+    m_compression = compression;
+}
 
-                    uint32_t requestId = head["requestId"].toInt();
+/**
+ * @brief Engine::compression
+ * @return
+ */
 
-                    {
-                        MutexLocker locker(m_requests);
+bool Engine::compression()
+{
+    MutexLocker locker(m_compression);
 
-                        if (m_requests->find(requestId) != m_requests->end()) {
+    return m_compression;
+}
 
-                            request = (*m_requests)[requestId];
-                        }
-                    }
-                }
+/**
+ * @brief Engine::setBatching
+ * @param batching
+ *
+ * Only to be enabled if the peer understands batches.
+ */
 
-                // process request
+void Engine::setBatching(bool batching)
+{
+    {
+        MutexLocker locker(m_batching);
 
-                if (request) {
+        m_batching = batching;
+    }
 
-                    if (!request->processResponse(head)) {
+    if (!batching) {
 
-                        // ...
-                    }
+        flushControl();
+    }
+}
 
+/**
+ * @brief Engine::batching
+ * @return
+ */
 
-                    request->setStatus(Request::Completed);
+bool Engine::batching()
+{
+    MutexLocker locker(m_batching);
 
+    return m_batching;
+}
 
-                    MutexLocker lock(m_requests);
+/**
+ * @brief Engine::streamReceiver
+ * @param streamId
+ * @return
+ */
 
-                    m_requests->erase(request->id());
+StreamReceiver$ Engine::streamReceiver(uint32_t streamId)
+{
+    MutexLocker locker(m_streamReceivers);
 
-                }
-                else
-                if (head.hasField("requestType")) {
+    auto it = m_streamReceivers->find(streamId);
+
+    if (it != m_streamReceivers->end()) {
+
+        return it->second;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Engine::createStreamReceiver
+ * @param pkt
+ * @return
+ */
+
+StreamReceiver$ Engine::createStreamReceiver(const Packet &pkt)
+{
+    if (pkt.streamType() == Packet::Request) {
+
+        // create request receiver
+
+        return UbjReceiver::create(pkt, [this] (UbjReceiver$ receiver, UBJ::Value &data) {
+
+            if (receiver->status() == StreamReceiver::Completed) {
 
-                    // incoming request
+                UBJ::Object head(data);
 
-                    if (!processIncomingRequest(head)) {
+                if (head.hasField("batch")) {
 
-                        // ...
+                    // unpack batched requests and responses
+
+                    for (auto &it : UBJ::Array(head["batch"])) {
+
+                        processRequestStream(it);
                     }
                 }
                 else {
 
-                    // ...
+                    processRequestStream(head);
                 }
             }
         });
@@ -354,6 +695,58 @@ StreamReceiver$ Engine::createStreamReceiver(const Packet &pkt)
     return nullptr;
 }
 
+/**
+ * @brief Engine::processRequestStream
+ * @param head
+ */
+
+void Engine::processRequestStream(const UBJ::Object &head)
+{
+    Request$ request;
+
+    if (head.hasField("requestId")) {
+
+        request = m_requests.find(head["requestId"].toInt());
+    }
+
+    // process request
+
+    if (request) {
+
+        if (!request->processResponse(head)) {
+
+            // ...
+        }
+
+
+        request->setStatus(Request::Completed);
+
+
+        {
+            MutexLocker lock(m_timeouts);
+
+            m_timeouts->cancel(request->id());
+        }
+
+        m_requests.erase(request->id());
+
+    }
+    else
+    if (head.hasField("requestType")) {
+
+        // incoming request
+
+        if (!processIncomingRequest(head)) {
+
+            // ...
+        }
+    }
+    else {
+
+        // ...
+    }
+}
+
 /**
  * @brief Engine::processIncomingPacket
  * @param pkt
@@ -362,16 +755,19 @@ StreamReceiver$ Engine::createStreamReceiver(const Packet &pkt)
 
 bool Engine::processIncomingPacket(Packet &pkt)
 {
-    MutexLocker locker(m_streamReceivers);
+    // the lock is only held for lookup and bookkeeping, the receiver
+    // thread looks up receivers for every incoming packet body
 
-    StreamReceiver$ receiver;
+    StreamReceiver$ receiver = streamReceiver(pkt.streamId());
 
-    if (m_streamReceivers->find(pkt.streamId()) == m_streamReceivers->end()) {
+    if (!receiver) {
 
         receiver = createStreamReceiver(pkt);
 
         if (receiver) {
 
+            MutexLocker locker(m_streamReceivers);
+
             (*m_streamReceivers)[pkt.streamId()] = receiver;
         }
         else {
@@ -379,10 +775,6 @@ bool Engine::processIncomingPacket(Packet &pkt)
             // ...
         }
     }
-    else {
-
-        receiver = (*m_streamReceivers)[pkt.streamId()];
-    }
 
     // process receiver
 
@@ -392,6 +784,8 @@ bool Engine::processIncomingPacket(Packet &pkt)
 
             if (receiver->status() == StreamReceiver::Completed) {
 
+                MutexLocker locker(m_streamReceivers);
+
                 m_streamReceivers->erase(receiver->id());
 
                 // ...
@@ -401,6 +795,8 @@ bool Engine::processIncomingPacket(Packet &pkt)
         }
         else {
 
+            MutexLocker locker(m_streamReceivers);
+
             m_streamReceivers->erase(receiver->id());
 
             // ...
@@ -421,6 +817,18 @@ bool Engine::processIncomingRequest(const UBJ::Object &request)
     return false;
 }
 
+/**
+ * @brief Engine::wake
+ *
+ * Called when control objects are waiting to be flushed, for the
+ * thread driving the engine to call flushControl() soon.
+ */
+
+void Engine::wake()
+{
+
+}
+
 /**
  * @brief Engine::processRequestTimeout
  * @param request
@@ -434,67 +842,95 @@ bool Engine::processRequestTimeout(Request$ request)
 
 /**
  * @brief Engine::processStreamSenders
- * @param numRounds
- * @param copyBody
  * @param packetCallback
  * @return
  */
 
-int32_t Engine::processStreamSenders(bool copyBody, std::function<bool (Packet$)> packetCallback)
+int32_t Engine::processStreamSenders(std::function<bool (Packet$)> packetCallback)
 {
     int32_t res=0;
 
-    // get snapshot of stream senders in order to prevent
-    // deadlocks when callbacks post new ones
+    // senders are taken off their queue while being processed, the
+    // queues are only popped here, on the thread sending the packets
 
-    StreamSenderList senders;
+    // priority lane: every pending request stream gets one packet,
+    // they are small and carry the interactive traffic
 
-    {
-        MutexLocker locker(m_streamSenders);
+    uint32_t numRequestSenders = m_requestSenders.size();
 
-        senders = *m_streamSenders;
-    }
+    for (uint32_t i=0; i<numRequestSenders; ++i) {
 
-    if (senders.empty()) {
+        StreamSender$ sender = m_requestSenders.pop();
 
-        return 0;
+        if (!sender) {
+
+            break;
+        }
+
+        int32_t bytes = processStreamSender(sender, packetCallback);
+
+        if (sender->status() == StreamSender::Outgoing) {
+
+            m_requestSenders.push(sender);
+        }
+
+        if (bytes < 0) {
+
+            return res;
+        }
+
+        if (bytes > 0) {
+
+            res++;
+        }
     }
 
-    for (auto &sender : senders) {
+    // resource lane: deficit round robin, the stream in turn may send
+    // packets worth its quantum of bytes, overdrawn bytes are charged
+    // to its next turn
 
-        Packet$ pkt;
+    StreamSender$ sender = m_resourceSenders.pop();
 
-        if (sender->process(pkt)) {
+    while (sender && sender->m_epoch != m_streamEpoch) {
 
-            if (pkt) {
+        sender->fail();
 
-                if (copyBody) {
+        sender = m_resourceSenders.pop();
+    }
 
-                    pkt->setBody(pkt->body()->copy(), pkt->bodySize());
-                }
+    if (sender) {
 
-                if (!packetCallback(pkt)) {
+        sender->m_deficit += sender->quantum();
 
-                    // ...
+        while (sender->m_deficit > 0) {
 
-                    return 0;
-                }
+            int32_t bytes = processStreamSender(sender, packetCallback);
 
-                res++;
+            if (bytes <= 0) {
+
+                break;
             }
 
-            if (sender->status() == StreamSender::Completed) {
+            sender->m_deficit -= bytes;
+
+            res++;
 
-                removeStreamSender(sender);
+            if (sender->status() != StreamSender::Outgoing) {
 
                 break;
             }
         }
-        else {
 
-            removeStreamSender(sender);
+        if (sender->status() == StreamSender::Outgoing) {
 
-            break;
+            // the turn is over, unused credit isn't saved up
+
+            if (sender->m_deficit > 0) {
+
+                sender->m_deficit = 0;
+            }
+
+            m_resourceSenders.push(sender);
         }
     }
 
@@ -502,15 +938,44 @@ int32_t Engine::processStreamSenders(bool copyBody, std::function<bool (Packet$)
 }
 
 /**
- * @brief Engine::removeStreamSender
+ * @brief Engine::processStreamSender
  * @param sender
+ * @param packetCallback
+ * @return
  */
 
-void Engine::removeStreamSender(StreamSender$ sender)
+int32_t Engine::processStreamSender(StreamSender$ sender, std::function<bool (Packet$)> &packetCallback)
 {
-    MutexLocker locker(m_streamSenders);
+    if (sender->m_epoch != m_streamEpoch) {
+
+        sender->fail();
+
+        return 0;
+    }
+
+    Packet$ pkt;
+
+    if (!sender->process(pkt)) {
+
+        return 0;
+    }
+
+    if (!pkt) {
+
+        return 0;
+    }
+
+    // packet bodies are leased from the packet pool,
+    // so they can be queued without copying
+
+    if (!packetCallback(pkt)) {
+
+        // ...
+
+        return -1;
+    }
 
-    m_streamSenders->remove(sender);
+    return pkt->bodySize() + sizeof(Packet::Head);
 }
 
 // ============================================================ //
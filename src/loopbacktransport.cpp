@@ -0,0 +1,273 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/loopbacktransport.h"
+
+#include <chrono>
+
+namespace Zway {
+
+const uint32_t LOOPBACK_BUFFER_SIZE = 1048576;
+
+// ============================================================ //
+
+/**
+ * @brief LoopbackTransport::createPair
+ * @param bandwidth bytes per second in each direction, 0 is unlimited
+ * @param latency one-way delay in ms
+ * @param bufferSize bytes in flight per direction before send blocks
+ * @return
+ */
+
+LoopbackTransport::Pair LoopbackTransport::createPair(uint64_t bandwidth, uint32_t latency, uint32_t bufferSize)
+{
+    Link$ links[2];
+
+    for (auto &link : links) {
+
+        link = std::make_shared<Link>();
+
+        link->bandwidth = bandwidth;
+
+        link->latency = latency;
+
+        link->bufferSize = bufferSize;
+
+        link->bytesQueued = 0;
+
+        link->busyUntil = 0;
+
+        link->packetsSent = 0;
+
+        link->bytesSent = 0;
+
+        link->closed = false;
+    }
+
+    return Pair(
+                LoopbackTransport$(new LoopbackTransport(links[0], links[1])),
+                LoopbackTransport$(new LoopbackTransport(links[1], links[0])));
+}
+
+/**
+ * @brief LoopbackTransport::LoopbackTransport
+ * @param in
+ * @param out
+ */
+
+LoopbackTransport::LoopbackTransport(Link$ in, Link$ out)
+    : m_in(in),
+      m_out(out)
+{
+
+}
+
+/**
+ * @brief LoopbackTransport::send
+ * @param pkt
+ * @return
+ *
+ * The packet is queued for the other end without copying, its body
+ * must not be modified afterwards.
+ */
+
+bool LoopbackTransport::send(Packet$ pkt)
+{
+    uint32_t size = sizeof(Packet::Head) + pkt->bodySize();
+
+    std::unique_lock<std::mutex> lock(m_out->mutex);
+
+    m_out->condition.wait(lock, [this] () {
+
+        return m_out->closed || m_out->bytesQueued < m_out->bufferSize;
+    });
+
+    if (m_out->closed) {
+
+        return false;
+    }
+
+    // the packet occupies the link for its transmission time
+    // and arrives after the latency on top of that
+
+    uint64_t time = now();
+
+    if (m_out->busyUntil < time) {
+
+        m_out->busyUntil = time;
+    }
+
+    if (m_out->bandwidth) {
+
+        m_out->busyUntil += size * 1000000ull / m_out->bandwidth;
+    }
+
+    m_out->queue.push_back({m_out->busyUntil + m_out->latency * 1000ull, pkt});
+
+    m_out->bytesQueued += size;
+
+    m_out->packetsSent++;
+
+    m_out->bytesSent += size;
+
+    m_out->condition.notify_all();
+
+    return true;
+}
+
+/**
+ * @brief LoopbackTransport::receive
+ * @param pkt
+ * @param ms
+ * @return false if no packet arrived within ms
+ */
+
+bool LoopbackTransport::receive(Packet &pkt, uint32_t ms)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+
+    std::unique_lock<std::mutex> lock(m_in->mutex);
+
+    for (;;) {
+
+        if (m_in->closed) {
+
+            return false;
+        }
+
+        if (!m_in->queue.empty()) {
+
+            uint64_t wait = 0;
+
+            uint64_t time = now();
+
+            if (m_in->queue.front().deliverAt > time) {
+
+                wait = m_in->queue.front().deliverAt - time;
+            }
+
+            if (!wait) {
+
+                break;
+            }
+
+            if (std::chrono::steady_clock::now() + std::chrono::microseconds(wait) > until) {
+
+                return false;
+            }
+
+            m_in->condition.wait_for(lock, std::chrono::microseconds(wait));
+        }
+        else
+        if (m_in->condition.wait_until(lock, until) == std::cv_status::timeout) {
+
+            return false;
+        }
+    }
+
+    Packet$ packet = m_in->queue.front().packet;
+
+    m_in->queue.pop_front();
+
+    m_in->bytesQueued -= sizeof(Packet::Head) + packet->bodySize();
+
+    m_in->condition.notify_all();
+
+    pkt = *packet;
+
+    return true;
+}
+
+/**
+ * @brief LoopbackTransport::close
+ *
+ * Closes both directions, blocked calls on either end return.
+ */
+
+void LoopbackTransport::close()
+{
+    for (auto &link : {m_in, m_out}) {
+
+        MutexLocker lock(link->mutex);
+
+        link->closed = true;
+
+        link->queue.clear();
+
+        link->condition.notify_all();
+    }
+}
+
+/**
+ * @brief LoopbackTransport::closed
+ * @return
+ */
+
+bool LoopbackTransport::closed()
+{
+    MutexLocker lock(m_out->mutex);
+
+    return m_out->closed;
+}
+
+/**
+ * @brief LoopbackTransport::packetsSent
+ * @return
+ */
+
+uint64_t LoopbackTransport::packetsSent()
+{
+    MutexLocker lock(m_out->mutex);
+
+    return m_out->packetsSent;
+}
+
+/**
+ * @brief LoopbackTransport::bytesSent
+ * @return
+ */
+
+uint64_t LoopbackTransport::bytesSent()
+{
+    MutexLocker lock(m_out->mutex);
+
+    return m_out->bytesSent;
+}
+
+/**
+ * @brief LoopbackTransport::now
+ * @return monotonic time in microseconds
+ */
+
+uint64_t LoopbackTransport::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================ //
+
+}
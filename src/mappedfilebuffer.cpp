@@ -0,0 +1,297 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/mappedfilebuffer.h"
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+ * @brief MappedFileBuffer::create
+ * @param path
+ * @return
+ */
+
+MappedFileBuffer$ MappedFileBuffer::create(const std::string &path)
+{
+    MappedFileBuffer$ res(new MappedFileBuffer());
+
+    if (!res->init(path)) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+/**
+ * @brief MappedFileBuffer::MappedFileBuffer
+ */
+
+MappedFileBuffer::MappedFileBuffer()
+{
+
+}
+
+/**
+ * @brief MappedFileBuffer::~MappedFileBuffer
+ */
+
+MappedFileBuffer::~MappedFileBuffer()
+{
+    release();
+}
+
+/**
+ * @brief MappedFileBuffer::init
+ * @param path
+ * @return
+ */
+
+bool MappedFileBuffer::init(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (uint64_t)st.st_size > UINT32_MAX) {
+
+        ::close(fd);
+
+        return false;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) {
+
+        ::close(fd);
+
+        return false;
+    }
+
+    // the descriptor is kept to notice the file shrinking
+
+    m_fd = fd;
+
+    m_data = (uint8_t*)data;
+
+    m_size = st.st_size;
+
+    // resources are read front to back, let the kernel read ahead
+
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+/**
+ * @brief MappedFileBuffer::release
+ */
+
+void MappedFileBuffer::release()
+{
+    if (m_data) {
+
+        munmap(m_data, m_size);
+    }
+
+    if (m_fd >= 0) {
+
+        ::close(m_fd);
+    }
+
+    m_fd = -1;
+
+    m_data = nullptr;
+
+    m_size = 0;
+}
+
+/**
+ * @brief MappedFileBuffer::read
+ * @param data
+ * @param size
+ * @param offset
+ * @param bytesRead
+ * @return
+ */
+
+bool MappedFileBuffer::read(uint8_t *data, uint32_t size, uint32_t offset, uint32_t *bytesRead)
+{
+    if (!m_data || !data) {
+
+        return false;
+    }
+
+    if (!available(offset, size)) {
+
+        return false;
+    }
+
+    memcpy(data, m_data + offset, size);
+
+    if (bytesRead) {
+
+        *bytesRead = size;
+    }
+
+    return true;
+}
+
+/**
+ * @brief MappedFileBuffer::write
+ * @param data
+ * @param size
+ * @param offset
+ * @param bytesWritten
+ * @return
+ *
+ * The mapping is read-only.
+ */
+
+bool MappedFileBuffer::write(const uint8_t *data, uint32_t size, uint32_t offset, uint32_t *bytesWritten)
+{
+    (void)data;
+
+    (void)size;
+
+    (void)offset;
+
+    (void)bytesWritten;
+
+    return false;
+}
+
+/**
+ * @brief MappedFileBuffer::available
+ * @param offset
+ * @param size
+ * @return false if the range isn't backed by the file anymore
+ *
+ * Touching pages of a mapping beyond the end of a file which was
+ * truncated meanwhile raises SIGBUS, so the file size is checked
+ * again before a range is accessed.
+ */
+
+bool MappedFileBuffer::available(uint32_t offset, uint32_t size)
+{
+    if (!m_data || (uint64_t)offset + size > m_size) {
+
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(m_fd, &st) != 0) {
+
+        return false;
+    }
+
+    return (uint64_t)offset + size <= (uint64_t)st.st_size;
+}
+
+/**
+ * @brief MappedFileBuffer::willNeed
+ * @param offset
+ * @param size
+ *
+ * Hints the kernel to start reading the given range ahead of use.
+ */
+
+void MappedFileBuffer::willNeed(uint32_t offset, uint32_t size)
+{
+    advise(offset, size, MADV_WILLNEED);
+}
+
+/**
+ * @brief MappedFileBuffer::dontNeed
+ * @param offset
+ * @param size
+ *
+ * Hints the kernel that the given range was consumed and its pages
+ * can be dropped from this mapping.
+ */
+
+void MappedFileBuffer::dontNeed(uint32_t offset, uint32_t size)
+{
+    advise(offset, size, MADV_DONTNEED);
+}
+
+/**
+ * @brief MappedFileBuffer::advise
+ * @param offset
+ * @param size
+ * @param advice
+ */
+
+void MappedFileBuffer::advise(uint32_t offset, uint32_t size, int advice)
+{
+    if (!m_data || offset >= m_size) {
+
+        return;
+    }
+
+    if ((uint64_t)offset + size > m_size) {
+
+        size = m_size - offset;
+    }
+
+    // madvise wants a page aligned start address
+
+    static const uint32_t pageSize = sysconf(_SC_PAGESIZE);
+
+    uint32_t start = offset - offset % pageSize;
+
+    madvise(m_data + start, size + (offset - start), advice);
+}
+
+/**
+ * @brief MappedFileBuffer::data
+ * @return
+ */
+
+const uint8_t *MappedFileBuffer::data()
+{
+    return m_data;
+}
+
+// ============================================================ //
+
+}
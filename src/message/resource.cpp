@@ -28,8 +28,10 @@
 #include "Zway/crypto/digest.h"
 #include "Zway/packet.h"
 #include "Zway/memorybuffer.h"
+#include "Zway/mappedfilebuffer.h"
 #include "Zway/message/resource.h"
 #include "Zway/store.h"
+#include "Zway/thread/executor.h"
 #include "Zway/ubj/store/blob.h"
 
 namespace Zway {
@@ -51,8 +53,7 @@ Resource$ Resource::create()
  */
 
 Resource::Resource()
-    : UBJ::Object(),
-      m_parts(0)
+    : UBJ::Object()
 {
 
 }
@@ -196,12 +197,13 @@ uint32_t Resource::size()
 
 /**
  * @brief Resource::parts
+ * @param bodySize
  * @return
  */
 
-uint32_t Resource::parts()
+uint32_t Resource::parts(uint32_t bodySize)
 {
-    return m_parts;
+    return Packet::numParts(size(), bodySize);
 }
 
 /**
@@ -250,72 +252,150 @@ FileSystemResource::FileSystemResource(const std::string &path, const std::strin
     setField("name", name);
 }
 
+/**
+ * @brief FileSystemResource::~FileSystemResource
+ */
+
+FileSystemResource::~FileSystemResource()
+{
+    // a hash nobody waits for anymore is abandoned
+
+    if (m_hashCanceled) {
+
+        *m_hashCanceled = true;
+    }
+}
+
 /**
  * @brief FileSystemResource::init
  * @param path
  * @return
+ *
+ * Maps the file instead of reading it, its contents are paged in as
+ * parts are read. The hash is computed on the shared executor so that
+ * attaching a file returns right away, without a thread per file.
  */
 
 bool FileSystemResource::init(const std::string &path)
 {
-    std::ifstream fs(path);
+    m_file = MappedFileBuffer::create(path);
 
-    if (!fs) {
+    if (!m_file) {
 
         return false;
     }
 
-    fs.seekg(0, std::ios_base::end);
+    m_data = m_file;
+
+    setField("path", path);
 
-    uint32_t size = fs.tellg();
+    MappedFileBuffer$ file = m_file;
 
-    fs.seekg(0, std::ios_base::beg);
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
 
-    if (!size) {
+    std::shared_ptr<std::atomic<bool>> canceled = std::make_shared<std::atomic<bool>>(false);
 
-        return false;
+    m_hash = promise->get_future().share();
+
+    m_hashCanceled = canceled;
+
+    // every hash gets a key of its own, so they run in parallel
+
+    static std::atomic<uint64_t> hashKey(0);
+
+    Executor::Task task = [file, promise, canceled] () {
+
+        promise->set_value(computeHash(file, *canceled));
+    };
+
+    Executor$ executor = Executor::instance();
+
+    if (!executor->post(hashKey++, task)) {
+
+        task();
     }
 
-    m_data = MemoryBuffer::create(nullptr, size);
+    return true;
+}
 
-    if (!m_data) {
+/**
+ * @brief FileSystemResource::read
+ * @param buf
+ * @param size
+ * @param offset
+ * @return
+ */
+
+bool FileSystemResource::read(MemoryBuffer$ buf, uint32_t size, uint32_t offset)
+{
+    if (!Resource::read(buf, size, offset)) {
 
         return false;
     }
 
-    Crypto::Digest digest(Crypto::Digest::DIGEST_SHA256);
-
-    uint32_t chunkSize = 4096;
+    // parts are read in order, have the next one paged in meanwhile
 
-    uint32_t bytesRead = 0;
+    m_file->willNeed(offset + (size ? size : buf->size()), size ? size : buf->size());
 
-    MemoryBuffer$ buf = MemoryBuffer::create(nullptr, chunkSize);
+    return true;
+}
 
-    while (bytesRead < size) {
+/**
+ * @brief FileSystemResource::hash
+ * @return
+ *
+ * Waits for the hash if it is still being computed, the first caller
+ * stores it in the resource.
+ */
 
-        uint32_t bytesToRead = chunkSize;
+std::string FileSystemResource::hash()
+{
+    std::call_once(m_hashOnce, [this] () {
 
-        if (size - bytesRead < chunkSize) {
+        if (m_hash.valid() && !m_hash.get().empty()) {
 
-            bytesToRead = size - bytesRead;
+            setField("hash", m_hash.get());
         }
+    });
 
-        fs.read((char*)buf->data(), bytesToRead);
+    return Resource::hash();
+}
 
-        m_data->write(buf->data(), bytesToRead, bytesRead, nullptr);
+/**
+ * @brief FileSystemResource::computeHash
+ * @param file
+ * @param canceled
+ * @return an empty string if the file shrank or hashing was canceled
+ */
 
-        digest.update(buf->data(), bytesToRead);
+std::string FileSystemResource::computeHash(MappedFileBuffer$ file, const std::atomic<bool> &canceled)
+{
+    Crypto::Digest digest(Crypto::Digest::DIGEST_SHA256);
 
-        bytesRead += bytesToRead;
-    }
+    const uint32_t chunkSize = 1048576;
 
-    setField("hash", Crypto::hexStr(digest.result()));
+    uint32_t bytesHashed = 0;
 
-    setField("path", path);
+    while (bytesHashed < file->size()) {
 
-    m_parts = size / MAX_PACKET_BODY + (size % MAX_PACKET_BODY ? 1 : 0);
+        uint32_t bytesToHash = chunkSize;
 
-    return true;
+        if (file->size() - bytesHashed < chunkSize) {
+
+            bytesToHash = file->size() - bytesHashed;
+        }
+
+        if (canceled || !file->available(bytesHashed, bytesToHash)) {
+
+            return std::string();
+        }
+
+        digest.update((uint8_t*)file->data() + bytesHashed, bytesToHash);
+
+        bytesHashed += bytesToHash;
+    }
+
+    return Crypto::hexStr(digest.result());
 }
 
 // ============================================================ //
@@ -415,8 +495,6 @@ bool LocalStoreResource::init(uint32_t nodeId, uint32_t resourceId)
 
     setField("hash", data["hash"]);
 
-    m_parts = blobSize / MAX_PACKET_BODY + (blobSize % MAX_PACKET_BODY ? 1 : 0);
-
     return true;
 }
 
@@ -28,6 +28,8 @@
 
 namespace Zway {
 
+const uint32_t RESOURCE_CHECKPOINT_BYTES = 1048576;
+
 // ============================================================ //
 
 /**
@@ -55,13 +57,56 @@ ResourceReceiver$ ResourceReceiver::create(
     return receiver;
 }
 
+/**
+ * @brief ResourceReceiver::create
+ * @param pkt
+ * @param key
+ * @param salt
+ * @param blob
+ * @param callback
+ * @param bodySize
+ * @return
+ *
+ * Creates a receiver that writes each decrypted part straight into
+ * the given (writable) store blob instead of assembling the resource
+ * in memory. The blob must be sized for the whole resource.
+ *
+ * The stream may start at a later part when a transfer is resumed,
+ * its body size has to be given then as it can't be taken from the
+ * first packet, which might be the (shorter) last part.
+ */
+
+ResourceReceiver$ ResourceReceiver::create(
+        const Packet &pkt,
+        MemoryBuffer$ key,
+        MemoryBuffer$ salt,
+        UBJ::Store::Blob$ blob,
+        BufferReceiverCallback callback,
+        uint32_t bodySize)
+{
+    if (!blob) {
+
+        return nullptr;
+    }
+
+    ResourceReceiver$ receiver(new ResourceReceiver(callback));
+
+    if (!receiver->init(pkt, key, salt, blob, bodySize)) {
+
+        return nullptr;
+    }
+
+    return receiver;
+}
+
 /**
  * @brief ResourceReceiver::ResourceReceiver
  * @param callback
  */
 
 ResourceReceiver::ResourceReceiver(BufferReceiverCallback callback)
-    : BufferReceiver(callback)
+    : BufferReceiver(callback),
+      m_checkpointBytes(0)
 {
 
 }
@@ -71,16 +116,73 @@ ResourceReceiver::ResourceReceiver(BufferReceiverCallback callback)
  * @param pkt
  * @param key
  * @param salt
+ * @param blob
+ * @param bodySize
  * @return
  */
 
-bool ResourceReceiver::init(const Packet &pkt, MemoryBuffer$ key, MemoryBuffer$ salt)
+bool ResourceReceiver::init(const Packet &pkt, MemoryBuffer$ key, MemoryBuffer$ salt, UBJ::Store::Blob$ blob, uint32_t bodySize)
 {
     if (!(key && salt)) {
 
         return false;
     }
 
+    if (blob) {
+
+        // no stream buffer, parts go to the blob as they arrive
+
+        if (!StreamReceiver::init(pkt)) {
+
+            return false;
+        }
+
+        m_bodySize = bodySize ? bodySize : pkt.bodySize();
+
+        if (!m_bodySize || m_bodySize > MAX_JUMBO_PACKET_BODY) {
+
+            return false;
+        }
+
+        if (!pkt.part() || !pkt.parts() || pkt.part() > pkt.parts()) {
+
+            return false;
+        }
+
+        // the ciphers are repositioned at part offsets, which have to
+        // fall on a cipher block, see Engine::setPacketBodySize()
+
+        if (pkt.parts() > 1 && m_bodySize % 16) {
+
+            return false;
+        }
+
+        if ((uint64_t)(pkt.parts() - 1) * m_bodySize >= blob->size()) {
+
+            return false;
+        }
+
+        // both ciphers continue at the offset of the first part
+
+        uint32_t offset = (pkt.part() - 1) * m_bodySize;
+
+        if (!blob->seek(offset)) {
+
+            return false;
+        }
+
+        m_aes.setKey(key);
+
+        if (!m_aes.setCtr(salt, offset)) {
+
+            return false;
+        }
+
+        m_blob = blob;
+
+        return true;
+    }
+
     if (!BufferReceiver::init(pkt)) {
 
         return false;
@@ -103,12 +205,54 @@ bool ResourceReceiver::processPacket(Packet &pkt)
 {
     if (pkt.bodySize()) {
 
-        if (!m_aes.decrypt(pkt.body(), pkt.body(), pkt.bodySize())) {
+        if (!m_aes.decrypt(pkt.bodyData(), pkt.bodyData(), pkt.bodySize())) {
 
             return false;
         }
     }
 
+    if (m_blob) {
+
+        if (!StreamReceiver::processPacket(pkt)) {
+
+            return false;
+        }
+
+        if (pkt.bodySize() > m_bodySize) {
+
+            return false;
+        }
+
+        // parts arrive in order, so the blob's cipher stream stays
+        // in step with the offsets written to
+
+        uint64_t offset = (uint64_t)(pkt.part()-1) * m_bodySize;
+
+        if (offset + pkt.bodySize() > m_blob->size()) {
+
+            return false;
+        }
+
+        if (pkt.bodySize() && !m_blob->write(pkt.bodyData(), pkt.bodySize(), offset)) {
+
+            return false;
+        }
+
+        m_bytesReceived += pkt.bodySize();
+
+        m_checkpointBytes += pkt.bodySize();
+
+        if (m_checkpointBytes >= RESOURCE_CHECKPOINT_BYTES && pkt.part() < m_parts) {
+
+            if (!checkpoint(pkt.part())) {
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     if (!BufferReceiver::processPacket(pkt)) {
 
         return false;
@@ -117,6 +261,86 @@ bool ResourceReceiver::processPacket(Packet &pkt)
     return true;
 }
 
+/**
+ * @brief ResourceReceiver::checkpoint
+ * @param part
+ * @return
+ *
+ * Closes the blob so that the parts written so far are committed,
+ * lets the callback record the part, then reopens the blob at the
+ * following part.
+ */
+
+bool ResourceReceiver::checkpoint(uint32_t part)
+{
+    m_checkpointBytes = 0;
+
+    if (!m_checkpointCallback) {
+
+        return true;
+    }
+
+    m_blob->close();
+
+    m_checkpointCallback(std::dynamic_pointer_cast<ResourceReceiver>(shared_from_this()), part);
+
+    if (!m_blob->reopen()) {
+
+        return false;
+    }
+
+    if (!m_blob->seek(part * m_bodySize)) {
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief ResourceReceiver::setCheckpointCallback
+ * @param callback
+ */
+
+void ResourceReceiver::setCheckpointCallback(ResourceCheckpointCallback callback)
+{
+    m_checkpointCallback = callback;
+}
+
+/**
+ * @brief ResourceReceiver::invokeCallback
+ */
+
+void ResourceReceiver::invokeCallback()
+{
+    if (m_blob) {
+
+        m_blob->close();
+    }
+
+    BufferReceiver::invokeCallback();
+}
+
+/**
+ * @brief ResourceReceiver::blob
+ * @return
+ */
+
+UBJ::Store::Blob$ ResourceReceiver::blob()
+{
+    return m_blob;
+}
+
+/**
+ * @brief ResourceReceiver::bodySize
+ * @return
+ */
+
+uint32_t ResourceReceiver::bodySize()
+{
+    return m_bodySize;
+}
+
 // ============================================================ //
 
 }
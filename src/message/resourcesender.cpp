@@ -26,9 +26,13 @@
 
 #include "Zway/message/resourcesender.h"
 #include "Zway/message/resource.h"
+#include "Zway/memorybuffer.h"
+#include "Zway/spoolfilebuffer.h"
 
 namespace Zway {
 
+const uint32_t RESOURCE_SPOOL_CHUNK = 1048576;
+
 // ============================================================ //
 
 /**
@@ -37,6 +41,8 @@ namespace Zway {
  * @param key
  * @param salt
  * @param callback
+ * @param bodySize
+ * @param startPart
  * @return
  */
 
@@ -44,11 +50,13 @@ ResourceSender$ ResourceSender::create(
         Resource$ res,
         MemoryBuffer$ key,
         MemoryBuffer$ salt,
-        StreamSenderCallback callback)
+        StreamSenderCallback callback,
+        uint32_t bodySize,
+        uint32_t startPart)
 {
     ResourceSender$ sender(new ResourceSender(res, callback));
 
-    if (!sender->init(key, salt)) {
+    if (!sender->init(key, salt, bodySize, startPart)) {
 
         return nullptr;
     }
@@ -64,7 +72,8 @@ ResourceSender$ ResourceSender::create(
 
 ResourceSender::ResourceSender(Resource$ res, StreamSenderCallback callback)
     : StreamSender(0, Packet::Resource, 0, callback),
-      m_res(res)
+      m_res(res),
+      m_spooled(0)
 {
 
 }
@@ -73,10 +82,12 @@ ResourceSender::ResourceSender(Resource$ res, StreamSenderCallback callback)
  * @brief ResourceSender::init
  * @param key
  * @param salt
+ * @param bodySize
+ * @param startPart
  * @return
  */
 
-bool ResourceSender::init(MemoryBuffer$ key, MemoryBuffer$ salt)
+bool ResourceSender::init(MemoryBuffer$ key, MemoryBuffer$ salt, uint32_t bodySize, uint32_t startPart)
 {
     if (!m_res) {
 
@@ -93,6 +104,11 @@ bool ResourceSender::init(MemoryBuffer$ key, MemoryBuffer$ salt)
         return false;
     }
 
+    if (!setBodySize(bodySize)) {
+
+        return false;
+    }
+
     if (!StreamSender::init(m_res->size())) {
 
         return false;
@@ -102,9 +118,74 @@ bool ResourceSender::init(MemoryBuffer$ key, MemoryBuffer$ salt)
 
     m_aes.setKey(key);
 
-    m_aes.setCtr(salt);
+    // a resumed transfer continues with the part the receiver asked
+    // for, the cipher is moved to that part's offset
+
+    if (startPart > 1) {
+
+        if (!setStartPart(startPart)) {
+
+            return false;
+        }
+
+        if (!m_aes.setCtr(salt, (uint64_t)m_part * m_bodySize)) {
+
+            return false;
+        }
+    }
+    else {
+
+        m_aes.setCtr(salt);
+    }
+
+    return true;
+}
+
+/**
+ * @brief ResourceSender::enableSpooling
+ * @return false if no spool file could be created
+ *
+ * The resource is encrypted ahead into a spool file in chunks, packet
+ * bodies are ranges of that file, which a kernel tls socket sends
+ * without copying them through user space. Has to be called before
+ * the first packet.
+ */
+
+bool ResourceSender::enableSpooling()
+{
+#if defined _WIN32
+
+    return false;
+
+#else
+
+    if (m_spool) {
+
+        return true;
+    }
+
+    m_spool = SpoolFileBuffer::create();
+
+    if (!m_spool) {
+
+        return false;
+    }
+
+    m_spooled = m_part * m_bodySize;
 
     return true;
+
+#endif
+}
+
+/**
+ * @brief ResourceSender::leasesBody
+ * @return
+ */
+
+bool ResourceSender::leasesBody()
+{
+    return !m_spool;
 }
 
 /**
@@ -122,6 +203,18 @@ bool ResourceSender::preparePacket(Packet$ &pkt, uint32_t bytesToSend, uint32_t
         return false;
     }
 
+    if (m_spool) {
+
+        if (m_spooled < bytesSent + bytesToSend && !spool(bytesSent + bytesToSend)) {
+
+            return false;
+        }
+
+        pkt->setBodyFile(m_spool, bytesToSend, bytesSent);
+
+        return true;
+    }
+
     // read chunk from resource into body buffer
 
     if (!m_res->read(m_body, bytesToSend, bytesSent)) {
@@ -144,7 +237,9 @@ bool ResourceSender::preparePacket(Packet$ &pkt, uint32_t bytesToSend, uint32_t
 
 bool ResourceSender::processPacket(Packet$ &pkt)
 {
-    if (pkt->bodySize()) {
+    // spooled bodies are encrypted already
+
+    if (pkt->bodySize() && pkt->body()) {
 
         if (!m_aes.encrypt(pkt->body(), pkt->body(), pkt->bodySize())) {
 
@@ -167,6 +262,64 @@ void ResourceSender::invokeCallback()
     }
 }
 
+/**
+ * @brief ResourceSender::spool
+ * @param size
+ * @return
+ *
+ * Encrypts the resource into the spool file until it holds at least
+ * size bytes, a chunk at a time.
+ */
+
+bool ResourceSender::spool(uint32_t size)
+{
+    if (!m_spoolBuffer) {
+
+        m_spoolBuffer = MemoryBuffer::create(nullptr, RESOURCE_SPOOL_CHUNK);
+
+        if (!m_spoolBuffer) {
+
+            return false;
+        }
+    }
+
+    while (m_spooled < size) {
+
+        uint32_t chunk = m_res->size() - m_spooled;
+
+        if (chunk > RESOURCE_SPOOL_CHUNK) {
+
+            chunk = RESOURCE_SPOOL_CHUNK;
+        }
+
+        if (!m_res->read(m_spoolBuffer, chunk, m_spooled)) {
+
+            return false;
+        }
+
+        if (!m_aes.encrypt(m_spoolBuffer, m_spoolBuffer, chunk)) {
+
+            return false;
+        }
+
+        if (!m_spool->write(m_spoolBuffer->data(), chunk, m_spooled, nullptr)) {
+
+            return false;
+        }
+
+        m_spooled += chunk;
+    }
+
+    // the resource is spooled completely
+
+    if (m_spooled == m_res->size()) {
+
+        m_spoolBuffer = nullptr;
+    }
+
+    return true;
+}
+
 // ============================================================ //
 
 }
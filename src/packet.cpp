@@ -33,6 +33,10 @@ namespace Zway {
 
 const uint32_t MAX_PACKET_BODY = 65536;
 
+const uint32_t MIN_PACKET_BODY = 4096;
+
+const uint32_t MAX_JUMBO_PACKET_BODY = 1048576;
+
 // ============================================================ //
 
 /**
@@ -46,12 +50,30 @@ Packet$ Packet::create(uint32_t id)
     return Packet$(new Packet(id));
 }
 
+/**
+ * @brief Packet::numParts
+ * @param size
+ * @param bodySize
+ * @return
+ */
+
+uint32_t Packet::numParts(uint32_t size, uint32_t bodySize)
+{
+    if (!size || !bodySize) {
+
+        return 0;
+    }
+
+    return size / bodySize + (size % bodySize ? 1 : 0);
+}
+
 /**
  * @brief Packet::Packet
  * @param id
  */
 
 Packet::Packet(uint32_t id)
+    : m_bodyOffset(0)
 {
     memset(&m_head, 0, sizeof(m_head));
 
@@ -95,7 +117,19 @@ uint32_t Packet::streamId() const
 
 Packet::StreamType Packet::streamType() const
 {
-    return (StreamType)m_head.streamType;
+    // the upper 16 bits of the stream type field carry the stream flags
+
+    return (StreamType)(m_head.streamType & 0xffff);
+}
+
+/**
+ * @brief Packet::streamFlags
+ * @return
+ */
+
+uint32_t Packet::streamFlags() const
+{
+    return m_head.streamType >> 16;
 }
 
 /**
@@ -135,7 +169,7 @@ uint32_t Packet::bodySize() const
 
 uint8_t* Packet::bodyData()
 {
-    return m_body->data();
+    return m_body ? m_body->data() + m_bodyOffset : nullptr;
 }
 
 /**
@@ -148,6 +182,26 @@ MemoryBuffer$ Packet::body()
     return m_body;
 }
 
+/**
+ * @brief Packet::bodyFile
+ * @return
+ */
+
+SpoolFileBuffer$ Packet::bodyFile()
+{
+    return m_bodyFile;
+}
+
+/**
+ * @brief Packet::bodyOffset
+ * @return
+ */
+
+uint32_t Packet::bodyOffset() const
+{
+    return m_bodyOffset;
+}
+
 /**
  * @brief Packet::setId
  * @param id
@@ -175,7 +229,17 @@ void Packet::setStreamId(uint32_t id)
 
 void Packet::setStreamType(StreamType type)
 {
-    m_head.streamType = type;
+    m_head.streamType = (m_head.streamType & 0xffff0000) | (type & 0xffff);
+}
+
+/**
+ * @brief Packet::setStreamFlags
+ * @param flags
+ */
+
+void Packet::setStreamFlags(uint32_t flags)
+{
+    m_head.streamType = (flags << 16) | (m_head.streamType & 0xffff);
 }
 
 /**
@@ -212,16 +276,45 @@ void Packet::setBodySize(uint32_t size)
  * @brief Packet::setBody
  * @param body
  * @param size
+ * @param offset
+ *
+ * The body may be a region of a larger buffer starting at offset,
+ * like the buffer of the stream receiver it has been received into.
  */
 
-void Packet::setBody(MemoryBuffer$ body, uint32_t size)
+void Packet::setBody(MemoryBuffer$ body, uint32_t size, uint32_t offset)
 {
     if (body) {
 
-        m_head.bodySize = size ? size : body->size();
+        m_head.bodySize = size ? size : body->size() - offset;
     }
 
     m_body = body;
+
+    m_bodyFile = nullptr;
+
+    m_bodyOffset = offset;
+}
+
+/**
+ * @brief Packet::setBodyFile
+ * @param file
+ * @param size
+ * @param offset
+ *
+ * The body is a range of a file, for transports which let the kernel
+ * send it. There is no body data in memory then.
+ */
+
+void Packet::setBodyFile(SpoolFileBuffer$ file, uint32_t size, uint32_t offset)
+{
+    m_head.bodySize = size;
+
+    m_body = nullptr;
+
+    m_bodyFile = file;
+
+    m_bodyOffset = offset;
 }
 
 // ============================================================ //
@@ -0,0 +1,580 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/reactor.h"
+
+#include <chrono>
+
+#if defined _WIN32
+#include <winsock2.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace Zway {
+
+const uint32_t REACTOR_INFINITE = (uint32_t)-1;
+
+// ============================================================ //
+
+/**
+ * @brief Reactor::Reactor
+ */
+
+Reactor::Reactor()
+    : m_socket(-1),
+      m_pollFd(-1),
+      m_wakeFds{-1, -1},
+      m_ready(0),
+      m_interest{0, 0},
+      m_wakeups(0),
+      m_polling(false)
+{
+
+}
+
+/**
+ * @brief Reactor::~Reactor
+ */
+
+Reactor::~Reactor()
+{
+    detach();
+
+    close();
+}
+
+/**
+ * @brief Reactor::attach
+ * @param socket non-blocking socket
+ * @return
+ */
+
+bool Reactor::attach(intptr_t socket)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!open()) {
+
+        return false;
+    }
+
+#if defined __linux__
+
+    if (m_socket != -1) {
+
+        epoll_ctl(m_pollFd, EPOLL_CTL_DEL, m_socket, nullptr);
+    }
+
+    struct epoll_event ev = {};
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+    ev.data.fd = socket;
+
+    if (epoll_ctl(m_pollFd, EPOLL_CTL_ADD, socket, &ev) != 0) {
+
+        return false;
+    }
+
+#endif
+
+    m_socket = socket;
+
+    // a new socket may be ready already, the first attempt finds out
+
+    m_ready = Readable | Writable;
+
+    m_condition.notify_all();
+
+    return true;
+}
+
+/**
+ * @brief Reactor::detach
+ *
+ * Threads waiting for the socket return with an error.
+ */
+
+void Reactor::detach()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_socket == -1) {
+
+        return;
+    }
+
+#if defined __linux__
+
+    epoll_ctl(m_pollFd, EPOLL_CTL_DEL, m_socket, nullptr);
+
+#endif
+
+    m_socket = -1;
+
+    m_ready = 0;
+
+    if (m_polling) {
+
+        interrupt();
+    }
+
+    m_condition.notify_all();
+}
+
+/**
+ * @brief Reactor::attached
+ * @return
+ */
+
+bool Reactor::attached()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_socket != -1;
+}
+
+/**
+ * @brief Reactor::set
+ * @param events
+ *
+ * Marks events ready again after an attempt that didn't run dry.
+ */
+
+void Reactor::set(uint32_t events)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_socket != -1) {
+
+        m_ready |= events;
+
+        m_condition.notify_all();
+    }
+}
+
+/**
+ * @brief Reactor::clear
+ * @param events
+ *
+ * To be called before the I/O attempt whose EAGAIN is waited for.
+ */
+
+void Reactor::clear(uint32_t events)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_ready &= ~events;
+}
+
+/**
+ * @brief Reactor::wait
+ * @param events Readable and/or Writable
+ * @param ms
+ * @return the ready events, Woken if wake() was called, 0 on timeout,
+ *         -1 if no socket is attached
+ */
+
+int32_t Reactor::wait(uint32_t events, uint32_t ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    uint64_t wakeups = m_wakeups;
+
+    for (;;) {
+
+        if (m_socket == -1) {
+
+            return -1;
+        }
+
+        uint32_t ready = m_ready & (events | Error);
+
+        if (ready) {
+
+            return ready;
+        }
+
+        if (m_wakeups != wakeups) {
+
+            return Woken;
+        }
+
+        int32_t remaining = -1;
+
+        if (ms != REACTOR_INFINITE) {
+
+            auto now = std::chrono::steady_clock::now();
+
+            if (now >= deadline) {
+
+                return 0;
+            }
+
+            remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+        }
+
+        // register the interest, a thread already polling for
+        // other events has to start over to include it
+
+        for (uint32_t i=0; i<2; ++i) {
+
+            if (events & (1 << i)) {
+
+                m_interest[i]++;
+            }
+        }
+
+        if (m_polling) {
+
+            interrupt();
+
+            if (ms == REACTOR_INFINITE) {
+
+                m_condition.wait(lock);
+            }
+            else {
+
+                m_condition.wait_until(lock, deadline);
+            }
+        }
+        else {
+
+            uint32_t interest = (m_interest[0] ? Readable : 0) | (m_interest[1] ? Writable : 0);
+
+            // read under the lock, detach() may reset it meanwhile
+
+            intptr_t socket = m_socket;
+
+            m_polling = true;
+
+            lock.unlock();
+
+            uint32_t ready = poll(socket, interest, remaining);
+
+            lock.lock();
+
+            m_polling = false;
+
+            if (m_socket != -1) {
+
+                m_ready |= ready;
+            }
+
+            m_condition.notify_all();
+        }
+
+        for (uint32_t i=0; i<2; ++i) {
+
+            if (events & (1 << i)) {
+
+                m_interest[i]--;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reactor::wake
+ *
+ * Makes the threads currently waiting return Woken.
+ */
+
+void Reactor::wake()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_wakeups++;
+
+    if (m_polling) {
+
+        interrupt();
+    }
+
+    m_condition.notify_all();
+}
+
+/**
+ * @brief Reactor::open
+ * @return
+ */
+
+bool Reactor::open()
+{
+    if (m_pollFd != -1 || m_wakeFds[0] != -1) {
+
+        return true;
+    }
+
+#if defined __linux__
+
+    m_pollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_pollFd == -1) {
+
+        return false;
+    }
+
+    m_wakeFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (m_wakeFds[0] == -1) {
+
+        close();
+
+        return false;
+    }
+
+    struct epoll_event ev = {};
+
+    ev.events = EPOLLIN;
+
+    ev.data.fd = m_wakeFds[0];
+
+    epoll_ctl(m_pollFd, EPOLL_CTL_ADD, m_wakeFds[0], &ev);
+
+#elif !defined _WIN32
+
+    if (pipe(m_wakeFds) != 0) {
+
+        m_wakeFds[0] = m_wakeFds[1] = -1;
+
+        return false;
+    }
+
+    for (auto fd : m_wakeFds) {
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Reactor::close
+ */
+
+void Reactor::close()
+{
+#if !defined _WIN32
+
+    for (auto fd : {m_pollFd, m_wakeFds[0], m_wakeFds[1]}) {
+
+        if (fd != -1) {
+
+            ::close(fd);
+        }
+    }
+
+#endif
+
+    m_pollFd = -1;
+
+    m_wakeFds[0] = m_wakeFds[1] = -1;
+}
+
+/**
+ * @brief Reactor::interrupt
+ *
+ * Makes the polling thread return from poll(), expects m_mutex locked.
+ */
+
+void Reactor::interrupt()
+{
+#if defined __linux__
+
+    uint64_t one = 1;
+
+    if (::write(m_wakeFds[0], &one, sizeof(one))) {
+
+    }
+
+#elif !defined _WIN32
+
+    char one = 1;
+
+    if (::write(m_wakeFds[1], &one, sizeof(one))) {
+
+    }
+
+#endif
+}
+
+/**
+ * @brief Reactor::poll
+ * @param socket
+ * @param interest
+ * @param ms -1 waits without timeout
+ * @return the events that arrived
+ */
+
+uint32_t Reactor::poll(intptr_t socket, uint32_t interest, int32_t ms)
+{
+    uint32_t ready = 0;
+
+#if defined __linux__
+
+    // the socket is registered edge-triggered for all events
+
+    (void)socket;
+
+    (void)interest;
+
+    struct epoll_event events[4];
+
+    int32_t n = epoll_wait(m_pollFd, events, 4, ms);
+
+    for (int32_t i=0; i<n; ++i) {
+
+        if (events[i].data.fd == m_wakeFds[0]) {
+
+            uint64_t value;
+
+            if (::read(m_wakeFds[0], &value, sizeof(value))) {
+
+            }
+
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+
+            ready |= Readable;
+        }
+
+        if (events[i].events & EPOLLOUT) {
+
+            ready |= Writable;
+        }
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+
+            ready |= Error | Readable | Writable;
+        }
+    }
+
+#elif !defined _WIN32
+
+    struct pollfd fds[2] = {};
+
+    fds[0].fd = socket;
+
+    fds[0].events = ((interest & Readable) ? POLLIN : 0) | ((interest & Writable) ? POLLOUT : 0);
+
+    fds[1].fd = m_wakeFds[0];
+
+    fds[1].events = POLLIN;
+
+    if (::poll(fds, 2, ms) > 0) {
+
+        if (fds[1].revents & POLLIN) {
+
+            char buf[64];
+
+            while (::read(m_wakeFds[0], buf, sizeof(buf)) > 0) {
+
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+
+            ready |= Readable;
+        }
+
+        if (fds[0].revents & POLLOUT) {
+
+            ready |= Writable;
+        }
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+
+            ready |= Error | Readable | Writable;
+        }
+    }
+
+#else
+
+    // no wakeup handle for select, wait in short slices
+
+    if (ms < 0 || ms > 200) {
+
+        ms = 200;
+    }
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+
+    fd_set wfds;
+    FD_ZERO(&wfds);
+
+    if (interest & Readable) {
+
+        FD_SET((SOCKET)socket, &rfds);
+    }
+
+    if (interest & Writable) {
+
+        FD_SET((SOCKET)socket, &wfds);
+    }
+
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+
+    if (select(0, &rfds, &wfds, nullptr, &tv) > 0) {
+
+        if (FD_ISSET((SOCKET)socket, &rfds)) {
+
+            ready |= Readable;
+        }
+
+        if (FD_ISSET((SOCKET)socket, &wfds)) {
+
+            ready |= Writable;
+        }
+    }
+
+#endif
+
+    return ready;
+}
+
+// ============================================================ //
+
+}
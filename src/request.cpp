@@ -26,10 +26,13 @@
 
 #include "Zway/request.h"
 #include "Zway/ubjsender.h"
+#include "Zway/util/timingwheel.h"
 
 namespace Zway {
 
-const uint32_t DEFAULT_TIMEOUT = 20;
+// milliseconds
+
+const uint32_t DEFAULT_TIMEOUT = 20000;
 
 // ============================================================ //
 
@@ -79,11 +82,11 @@ Request::~Request()
 
 /**
  * @brief Request::start
- * @param time
+ * @param compress
  * @return
  */
 
-StreamSender$ Request::start()
+StreamSender$ Request::start(bool compress)
 {
     m_head["requestId"] = m_id;
 
@@ -95,7 +98,7 @@ StreamSender$ Request::start()
 
             setStatus(WaitingForResponse);
         }
-    });
+    }, compress);
 
     if (!sender) {
 
@@ -104,7 +107,7 @@ StreamSender$ Request::start()
         return nullptr;
     }
 
-    m_time = time(nullptr);
+    m_time = TimingWheel::now();
 
     setStatus(Outgoing);
 
@@ -145,21 +148,44 @@ void Request::setStatus(Request::Status status)
 }
 
 /**
- * @brief Request::checkTimeout
- * @param time
+ * @brief Request::setTimeout
+ * @param timeout
+ *
+ * Sets the time in ms to wait for a response, 0 waits forever.
+ * Has to be set before the request is posted.
+ */
+
+void Request::setTimeout(uint32_t timeout)
+{
+    m_timeout = timeout;
+}
+
+/**
+ * @brief Request::timeout
  * @return
  */
 
-bool Request::checkTimeout(uint64_t time)
+uint32_t Request::timeout()
 {
-    if (m_timeout > 0 && m_time > 0 && time >= m_time + m_timeout) {
+    return m_timeout;
+}
 
-        setStatus(Timeout);
+/**
+ * @brief Request::deadline
+ * @return
+ *
+ * Returns the time on the monotonic clock (ms) at which the request
+ * times out, or 0 if it hasn't been started or has no timeout.
+ */
+
+uint64_t Request::deadline()
+{
+    if (m_timeout > 0 && m_time > 0) {
 
-        return true;
+        return m_time + m_timeout;
     }
 
-    return false;
+    return 0;
 }
 
 /**
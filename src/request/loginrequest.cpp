@@ -97,6 +97,18 @@ bool LoginRequest::init()
 
     m_head["config"] = config;
 
+    // propose body size for resource streams
+
+    m_head["packetBodySize"] = m_client->preferredPacketBodySize();
+
+    // announce that compressed request streams are understood
+
+    m_head["compression"] = 1;
+
+    // and batched control messages
+
+    m_head["batch"] = 1;
+
     return true;
 }
 
@@ -112,6 +124,29 @@ bool LoginRequest::processResponse(const UBJ::Object &response)
 
     if (status == 1) {
 
+        // apply negotiated body size, servers not aware
+        // of it keep the default body size
+
+        if (response.hasField("packetBodySize")) {
+
+            uint32_t bodySize = response["packetBodySize"].toInt();
+
+            if (bodySize > m_client->preferredPacketBodySize()) {
+
+                bodySize = m_client->preferredPacketBodySize();
+            }
+
+            m_client->setPacketBodySize(bodySize);
+        }
+
+        // compress outgoing request streams if the server supports it
+
+        m_client->setCompression(response["compression"].toInt() == 1);
+
+        // batch acks and responses if the server unpacks batches
+
+        m_client->setBatching(response["batch"].toInt() == 1);
+
         // set status
 
         m_client->setStatus(Client::Authenticated);
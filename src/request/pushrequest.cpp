@@ -103,7 +103,13 @@ PushRequest$ PushRequest::create(Client$ client, Message$ msg, uint32_t id, Requ
 PushRequest::PushRequest(Client$ client, Message$ msg, uint32_t id, RequestCallback callback)
     : Request(Push, UBJ_OBJ("requestId" << id), DEFAULT_TIMEOUT, callback),
       m_client(client),
-      m_msg(msg)
+      m_msg(msg),
+      m_bodySize(MAX_PACKET_BODY),
+      m_pushWindow(1),
+      m_resourcesStarted(0),
+      m_resourcesInFlight(0),
+      m_resourcesFinished(0),
+      m_pushEpoch(0)
 {
 
 }
@@ -127,6 +133,10 @@ bool PushRequest::init()
         m_id = Crypto::mkId();
     }
 
+    // resources are sent with the body size of the connection
+
+    m_bodySize = m_client->packetBodySize(Packet::Resource);
+
     // create message key
 
     m_key = MemoryBuffer::create(nullptr, 32);
@@ -233,7 +243,7 @@ bool PushRequest::init()
             resources <<
                     UBJ_OBJ(
                         "id"    << res->id() <<
-                        "parts" << res->parts());
+                        "parts" << res->parts(m_bodySize));
 
             metaResources <<
                     UBJ_OBJ(
@@ -303,14 +313,18 @@ bool PushRequest::init()
 
 /**
  * @brief PushRequest::pushResources
- * @param ids
+ * @param request
+ * @param resources
  * @param callback
- * @param index
+ *
+ * Starts sending the given resources, up to the client's per message
+ * window at a time and within its global upload window. The callback
+ * is invoked once every resource has either been sent or failed.
  */
 
-void PushRequest::pushResources(PushRequest$ request, const UBJ::Array &ids, const std::function<void (PushRequest$)> &callback, uint32_t index)
+void PushRequest::pushResources(PushRequest$ request, const UBJ::Array &resources, const std::function<void (PushRequest$)> &callback)
 {
-    if (ids.empty()) {
+    if (resources.empty()) {
 
         // no resources to push
 
@@ -319,117 +333,301 @@ void PushRequest::pushResources(PushRequest$ request, const UBJ::Array &ids, con
         return;
     }
 
-    uint32_t id = ids[index].toInt();
+    {
+        MutexLocker locker(request->m_pushMutex);
 
-    Resource$ res = request->message()->resourceById(id);
+        request->m_pushResources = resources;
 
-    if (res) {
+        request->m_pushCallback = callback;
 
-        MemoryBuffer$ salt = resourceSalt(request->m_salt, id);
+        request->m_pushWindow = request->m_client->resourceUploadWindow();
 
-        auto sender = ResourceSender::create(
-                    res, request->m_key, salt,
-                    [request, ids, id, callback, index] (StreamSender$ sender) {
+        request->m_resourcesStarted = 0;
 
-            if (sender->status() == StreamSender::Completed) {
+        request->m_resourcesInFlight = 0;
 
-                // update resource status
+        request->m_resourcesFinished = 0;
 
-                if (!request->m_client->store()->update(
-                            "resources",
-                            UBJ_OBJ("status" << Resource::Sent << "time" << (uint64_t)time(nullptr)),
-                            UBJ_OBJ("id" << id))) {
+        request->m_pushEpoch = request->m_client->streamEpoch();
+    }
 
-                    // ...
-                }
+    request->pushNext();
+}
 
+/**
+ * @brief PushRequest::pushNext
+ *
+ * Starts as many of the remaining resources as the windows allow.
+ * Called again whenever a resource finishes or the client frees an
+ * upload slot this request has been waiting for.
+ *
+ * Once the connection the push was answered on is gone, the resources
+ * not started yet are given up, the message stays outgoing and is
+ * resumed by pushing it again.
+ */
 
-                UBJ::Object resource;
+void PushRequest::pushNext()
+{
+    PushRequest$ request = std::dynamic_pointer_cast<PushRequest>(shared_from_this());
 
-                if (!request->m_client->store()->query(
-                            "resources",
-                            UBJ_OBJ("id" << id),
-                            &resource)) {
+    while (true) {
 
-                    // ...
-                }
+        UBJ::Value entry;
 
-                UBJ::Object message;
+        std::function<void (PushRequest$)> callback;
 
-                if (!request->m_client->store()->query(
-                            "messages",
-                            UBJ_OBJ("id" << request->m_id),
-                            &message)) {
+        {
+            MutexLocker locker(m_pushMutex);
 
-                    // ...
-                }
+            if (m_pushEpoch != m_client->streamEpoch()) {
 
-                // raise event
+                m_resourcesFinished += m_pushResources.size() - m_resourcesStarted;
 
-                request->m_client->postEvent(Event::create(Event::ResourceSent, UBJ_OBJ(
-                                                      "message" << message << "resource" << resource)));
+                m_resourcesStarted = m_pushResources.size();
 
+                if (m_resourcesFinished == m_pushResources.size()) {
 
-                // next resource
+                    callback = m_pushCallback;
 
-                if (index + 1 < ids.size()) {
-
-                    pushResources(request, ids, callback, index + 1);
-                }
-                else {
-
-                    callback(request);
+                    m_pushCallback = nullptr;
                 }
             }
-        });
+        }
 
-        if (!sender) {
+        if (callback) {
+
+            callback(request);
 
             return;
         }
 
-        // update resource status
+        {
+            MutexLocker locker(m_pushMutex);
+
+            if (m_resourcesStarted >= m_pushResources.size() ||
+                m_resourcesInFlight >= m_pushWindow) {
+
+                return;
+            }
 
-        if (!request->m_client->store()->update(
-                    "resources",
-                    UBJ_OBJ("status" << Resource::Outgoing),
-                    UBJ_OBJ("id" << id))) {
+            if (!m_client->acquireResourceUpload(request)) {
 
-            // ...
+                return;
+            }
+
+            entry = m_pushResources[m_resourcesStarted++];
+
+            m_resourcesInFlight++;
         }
 
-        UBJ::Object resource;
+        if (!pushResource(entry)) {
 
-        if (!request->m_client->store()->query(
-                    "resources",
-                    UBJ_OBJ("id" << id),
-                    &resource)) {
+            resourceFinished();
+        }
+    }
+}
 
-            // ...
+/**
+ * @brief PushRequest::pushResource
+ * @param entry
+ * @return
+ */
+
+bool PushRequest::pushResource(const UBJ::Value &entry)
+{
+    PushRequest$ request = std::dynamic_pointer_cast<PushRequest>(shared_from_this());
+
+    // entries are either plain ids or objects naming the part (and
+    // body size) to resume an interrupted transfer of the resource at
+
+    uint32_t id = entry.isObject() ? entry["id"].toInt() : entry.toInt();
+
+    uint32_t startPart = 1;
+
+    uint32_t bodySize = m_bodySize;
+
+    if (entry.isObject()) {
+
+        if (entry.hasField("part")) {
+
+            startPart = entry["part"].toInt();
         }
 
-        UBJ::Object message;
+        if (entry.hasField("bodySize")) {
+
+            bodySize = entry["bodySize"].toInt();
+        }
+    }
+
+    Resource$ res = m_msg->resourceById(id);
+
+    if (!res) {
+
+        return false;
+    }
+
+    // resume only with a body size this connection can carry,
+    // otherwise the resource is sent again from its first part
+
+    if (startPart != 1 &&
+        (!startPart ||
+         bodySize < MIN_PACKET_BODY ||
+         bodySize > m_client->packetBodySize(Packet::Resource) ||
+         bodySize % 16 ||
+         startPart > res->parts(bodySize))) {
+
+        startPart = 1;
+
+        bodySize = m_bodySize;
+    }
+
+    MemoryBuffer$ salt = resourceSalt(m_salt, id);
+
+    auto sender = ResourceSender::create(
+                res, m_key, salt,
+                [request, id] (StreamSender$ sender) {
+
+        if (sender->status() == StreamSender::Completed) {
+
+            // update resource status
+
+            if (!request->m_client->store()->update(
+                        "resources",
+                        UBJ_OBJ("status" << Resource::Sent << "time" << (uint64_t)time(nullptr)),
+                        UBJ_OBJ("id" << id))) {
 
-        if (!request->m_client->store()->query(
-                    "messages",
-                    UBJ_OBJ("id" << request->m_id),
-                    &message)) {
+                // ...
+            }
+
+
+            UBJ::Object resource;
+
+            if (!request->m_client->store()->query(
+                        "resources",
+                        UBJ_OBJ("id" << id),
+                        &resource)) {
+
+                // ...
+            }
+
+            UBJ::Object message;
 
-            // ...
+            if (!request->m_client->store()->query(
+                        "messages",
+                        UBJ_OBJ("id" << request->m_id),
+                        &message)) {
+
+                // ...
+            }
+
+            // raise event
+
+            request->m_client->postEvent(Event::create(Event::ResourceSent, UBJ_OBJ(
+                                                  "message" << message << "resource" << resource)));
+
+            request->resourceFinished();
+        }
+        else
+        if (sender->status() == StreamSender::Error) {
+
+            request->resourceFinished();
         }
+    }, bodySize, startPart);
+
+    if (!sender) {
 
-        // raise event
+        return false;
+    }
+
+    // update resource status
+
+    if (!m_client->store()->update(
+                "resources",
+                UBJ_OBJ("status" << Resource::Outgoing),
+                UBJ_OBJ("id" << id))) {
+
+        // ...
+    }
+
+    UBJ::Object resource;
+
+    if (!m_client->store()->query(
+                "resources",
+                UBJ_OBJ("id" << id),
+                &resource)) {
+
+        // ...
+    }
+
+    UBJ::Object message;
+
+    if (!m_client->store()->query(
+                "messages",
+                UBJ_OBJ("id" << m_id),
+                &message)) {
+
+        // ...
+    }
 
-        request->m_client->postEvent(Event::create(Event::ResourceOutgoing, UBJ_OBJ(
-                                              "message" << message << "resource" << resource)));
+    // raise event
 
-        // send resource
+    m_client->postEvent(Event::create(Event::ResourceOutgoing, UBJ_OBJ(
+                                          "message" << message << "resource" << resource)));
 
-        if (!request->m_client->addStreamSender(sender)) {
+    // send resource
 
-            // ...
+    if (!m_client->addStreamSender(sender)) {
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief PushRequest::resourceFinished
+ *
+ * Accounts for a resource that has been sent or failed, frees its
+ * upload slot and either continues with the next resources or, once
+ * all of them are done, invokes the push callback.
+ */
+
+void PushRequest::resourceFinished()
+{
+    bool done = false;
+
+    std::function<void (PushRequest$)> callback;
+
+    {
+        MutexLocker locker(m_pushMutex);
+
+        m_resourcesInFlight--;
+
+        m_resourcesFinished++;
+
+        if (m_resourcesFinished == m_pushResources.size()) {
+
+            done = true;
+
+            callback = m_pushCallback;
+
+            m_pushCallback = nullptr;
         }
     }
+
+    m_client->releaseResourceUpload();
+
+    if (done) {
+
+        if (callback) {
+
+            callback(std::dynamic_pointer_cast<PushRequest>(shared_from_this()));
+        }
+    }
+    else {
+
+        pushNext();
+    }
 }
 
 /**
@@ -482,7 +680,12 @@ bool PushRequest::processResponse(const UBJ::Object &response)
 
             for (auto &it : resources) {
 
-                Resource$ resource = m_msg->resourceById(it.toInt());
+                Resource$ resource = m_msg->resourceById(it.isObject() ? it["id"].toInt() : it.toInt());
+
+                if (!resource) {
+
+                    continue;
+                }
 
                 std::string name = resource->name();
 
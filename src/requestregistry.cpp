@@ -0,0 +1,262 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/requestregistry.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+ * @brief RequestRegistry::RequestRegistry
+ */
+
+RequestRegistry::RequestRegistry()
+    : m_count(0)
+{
+
+}
+
+/**
+ * @brief RequestRegistry::insert
+ * @param request
+ * @return false if a request with the same id is registered
+ */
+
+bool RequestRegistry::insert(Request$ request)
+{
+    Shard &s = shard(request->id());
+
+    MutexLocker locker(s.mutex);
+
+    if (!s.requests.emplace(request->id(), request).second) {
+
+        return false;
+    }
+
+    s.types[request->type()].insert(request->id());
+
+    ++m_count;
+
+    return true;
+}
+
+/**
+ * @brief RequestRegistry::find
+ * @param id
+ * @return
+ */
+
+Request$ RequestRegistry::find(uint32_t id)
+{
+    Shard &s = shard(id);
+
+    MutexLocker locker(s.mutex);
+
+    auto it = s.requests.find(id);
+
+    if (it == s.requests.end()) {
+
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+/**
+ * @brief RequestRegistry::take
+ * @param id
+ * @return
+ *
+ * Removes the request and returns it, only one caller gets it.
+ */
+
+Request$ RequestRegistry::take(uint32_t id)
+{
+    Shard &s = shard(id);
+
+    MutexLocker locker(s.mutex);
+
+    auto it = s.requests.find(id);
+
+    if (it == s.requests.end()) {
+
+        return nullptr;
+    }
+
+    Request$ request = it->second;
+
+    remove(s, request);
+
+    return request;
+}
+
+/**
+ * @brief RequestRegistry::erase
+ * @param id
+ * @return
+ */
+
+bool RequestRegistry::erase(uint32_t id)
+{
+    return take(id) != nullptr;
+}
+
+/**
+ * @brief RequestRegistry::pending
+ * @param type
+ * @param id
+ * @return
+ *
+ * With an id only the shard of that id is looked at, otherwise the
+ * type index of every shard.
+ */
+
+bool RequestRegistry::pending(Request::Type type, uint32_t id)
+{
+    if (id) {
+
+        Shard &s = shard(id);
+
+        MutexLocker locker(s.mutex);
+
+        auto it = s.requests.find(id);
+
+        return it != s.requests.end() && it->second->type() == type;
+    }
+
+    if (!m_count) {
+
+        return false;
+    }
+
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        if (s.types.find(type) != s.types.end()) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief RequestRegistry::count
+ * @return
+ */
+
+uint32_t RequestRegistry::count()
+{
+    return m_count;
+}
+
+/**
+ * @brief RequestRegistry::count
+ * @param type
+ * @return
+ */
+
+uint32_t RequestRegistry::count(Request::Type type)
+{
+    uint32_t count = 0;
+
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        auto it = s.types.find(type);
+
+        if (it != s.types.end()) {
+
+            count += it->second.size();
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief RequestRegistry::clear
+ */
+
+void RequestRegistry::clear()
+{
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        m_count -= s.requests.size();
+
+        s.requests.clear();
+
+        s.types.clear();
+    }
+}
+
+/**
+ * @brief RequestRegistry::shard
+ * @param id
+ * @return
+ */
+
+RequestRegistry::Shard &RequestRegistry::shard(uint32_t id)
+{
+    return m_shards[id % NUM_SHARDS];
+}
+
+/**
+ * @brief RequestRegistry::remove
+ * @param shard
+ * @param request
+ *
+ * Expects the shard to be locked.
+ */
+
+void RequestRegistry::remove(Shard &shard, Request$ request)
+{
+    shard.requests.erase(request->id());
+
+    auto it = shard.types.find(request->type());
+
+    if (it != shard.types.end()) {
+
+        it->second.erase(request->id());
+
+        if (it->second.empty()) {
+
+            shard.types.erase(it);
+        }
+    }
+
+    --m_count;
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,309 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/resolver.h"
+
+#if defined _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace Zway {
+
+const uint32_t RESOLVER_CACHE_TTL = 300000;
+
+const uint32_t RESOLVER_QUEUE_CAPACITY = 256;
+
+// ============================================================ //
+
+/**
+ * @brief Resolver::instance
+ * @return the resolver clients share by default
+ */
+
+Resolver$ Resolver::instance()
+{
+    static Resolver$ resolver = create();
+
+    return resolver;
+}
+
+/**
+ * @brief Resolver::create
+ * @return
+ */
+
+Resolver$ Resolver::create()
+{
+    Resolver$ resolver(new Resolver());
+
+    resolver->start();
+
+    return resolver;
+}
+
+/**
+ * @brief Resolver::Resolver
+ */
+
+Resolver::Resolver()
+    : Handler<ResolverQuery>(RESOLVER_QUEUE_CAPACITY),
+      m_cacheTtl(RESOLVER_CACHE_TTL)
+{
+
+}
+
+/**
+ * @brief Resolver::~Resolver
+ */
+
+Resolver::~Resolver()
+{
+    cancelAndJoin();
+}
+
+/**
+ * @brief Resolver::resolve
+ * @param host
+ * @param port
+ * @param callback gets the addresses, none if the lookup failed
+ *
+ * Cached addresses are handed to the callback right away, otherwise
+ * it is called on the resolver thread once the lookup is done.
+ */
+
+void Resolver::resolve(const std::string &host, uint16_t port, Callback callback)
+{
+    AddressList addresses;
+
+    {
+        MutexLocker lock(m_cache);
+
+        std::map<std::string, Entry> &cache = m_cache;
+
+        auto it = cache.find(key(host, port));
+
+        if (it != cache.end()) {
+
+            if (std::chrono::steady_clock::now() < it->second.expires) {
+
+                addresses = it->second.addresses;
+            }
+            else {
+
+                cache.erase(it);
+            }
+        }
+    }
+
+    if (!addresses.empty()) {
+
+        callback(addresses);
+
+        return;
+    }
+
+    ResolverQuery query;
+
+    query.host = host;
+
+    query.port = port;
+
+    query.callback = callback;
+
+    post(std::move(query));
+}
+
+/**
+ * @brief Resolver::invalidate
+ * @param host
+ * @param port
+ *
+ * Forgets the cached addresses, e.g. after none of them could be
+ * connected.
+ */
+
+void Resolver::invalidate(const std::string &host, uint16_t port)
+{
+    MutexLocker lock(m_cache);
+
+    std::map<std::string, Entry> &cache = m_cache;
+
+    cache.erase(key(host, port));
+}
+
+/**
+ * @brief Resolver::setCacheTtl
+ * @param ms 0 disables the cache
+ */
+
+void Resolver::setCacheTtl(uint32_t ms)
+{
+    m_cacheTtl = ms;
+}
+
+/**
+ * @brief Resolver::interleave
+ * @param addresses
+ * @return
+ *
+ * Alternates the address families, starting with the family of the
+ * first address, which getaddrinfo sorted by preference (RFC 8305).
+ */
+
+Resolver::AddressList Resolver::interleave(const AddressList &addresses)
+{
+    if (addresses.empty()) {
+
+        return addresses;
+    }
+
+    uint16_t family = ((const struct sockaddr*)addresses.front().data())->sa_family;
+
+    AddressList first;
+
+    AddressList second;
+
+    for (auto &address : addresses) {
+
+        if (((const struct sockaddr*)address.data())->sa_family == family) {
+
+            first.push_back(address);
+        }
+        else {
+
+            second.push_back(address);
+        }
+    }
+
+    AddressList result;
+
+    for (size_t i=0; i<first.size() || i<second.size(); ++i) {
+
+        if (i < first.size()) {
+
+            result.push_back(first[i]);
+        }
+
+        if (i < second.size()) {
+
+            result.push_back(second[i]);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Resolver::process
+ * @param query
+ */
+
+void Resolver::process(ResolverQuery &query)
+{
+    AddressList addresses = interleave(lookup(query.host, query.port));
+
+    uint32_t ttl = m_cacheTtl;
+
+    if (!addresses.empty() && ttl) {
+
+        MutexLocker lock(m_cache);
+
+        std::map<std::string, Entry> &cache = m_cache;
+
+        Entry &entry = cache[key(query.host, query.port)];
+
+        entry.addresses = addresses;
+
+        entry.expires = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttl);
+    }
+
+    if (query.callback) {
+
+        query.callback(addresses);
+    }
+}
+
+/**
+ * @brief Resolver::lookup
+ * @param host name or numeric address
+ * @param port
+ * @return IPv6 and IPv4 addresses usable on this host
+ */
+
+Resolver::AddressList Resolver::lookup(const std::string &host, uint16_t port)
+{
+    struct addrinfo hints = {};
+
+    hints.ai_family = AF_UNSPEC;
+
+    hints.ai_socktype = SOCK_STREAM;
+
+    hints.ai_protocol = IPPROTO_TCP;
+
+    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+    struct addrinfo *info = nullptr;
+
+    AddressList addresses;
+
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &info) != 0) {
+
+        return addresses;
+    }
+
+    for (struct addrinfo *ai = info; ai; ai = ai->ai_next) {
+
+        if (ai->ai_family == AF_INET || ai->ai_family == AF_INET6) {
+
+            addresses.push_back(std::string((const char*)ai->ai_addr, ai->ai_addrlen));
+        }
+    }
+
+    freeaddrinfo(info);
+
+    return addresses;
+}
+
+/**
+ * @brief Resolver::key
+ * @param host
+ * @param port
+ * @return
+ */
+
+std::string Resolver::key(const std::string &host, uint16_t port)
+{
+    return host + ":" + std::to_string(port);
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,220 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/spoolfilebuffer.h"
+
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+ * @brief SpoolFileBuffer::create
+ * @return
+ */
+
+SpoolFileBuffer$ SpoolFileBuffer::create()
+{
+    SpoolFileBuffer$ res(new SpoolFileBuffer());
+
+    if (!res->init()) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+/**
+ * @brief SpoolFileBuffer::SpoolFileBuffer
+ */
+
+SpoolFileBuffer::SpoolFileBuffer()
+{
+
+}
+
+/**
+ * @brief SpoolFileBuffer::~SpoolFileBuffer
+ */
+
+SpoolFileBuffer::~SpoolFileBuffer()
+{
+    if (m_fd != -1) {
+
+        ::close(m_fd);
+    }
+}
+
+/**
+ * @brief SpoolFileBuffer::init
+ * @return
+ */
+
+bool SpoolFileBuffer::init()
+{
+    const char *dir = getenv("TMPDIR");
+
+    std::string path = dir && *dir ? dir : "/tmp";
+
+#if defined O_TMPFILE
+
+    // never linked into the file system
+
+    m_fd = ::open(path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+
+#endif
+
+    if (m_fd == -1) {
+
+        std::string name = path + "/zway-spool-XXXXXX";
+
+        m_fd = mkstemp(&name[0]);
+
+        if (m_fd == -1) {
+
+            return false;
+        }
+
+        unlink(name.c_str());
+
+        fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    return true;
+}
+
+/**
+ * @brief SpoolFileBuffer::read
+ * @param data
+ * @param size
+ * @param offset
+ * @param bytesRead
+ * @return
+ */
+
+bool SpoolFileBuffer::read(uint8_t *data, uint32_t size, uint32_t offset, uint32_t *bytesRead)
+{
+    if (m_fd == -1 || !data) {
+
+        return false;
+    }
+
+    if ((uint64_t)offset + size > m_size) {
+
+        return false;
+    }
+
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        ssize_t r = pread(m_fd, data + s, size - s, offset + s);
+
+        if (r <= 0) {
+
+            return false;
+        }
+
+        s += r;
+    }
+
+    if (bytesRead) {
+
+        *bytesRead = size;
+    }
+
+    return true;
+}
+
+/**
+ * @brief SpoolFileBuffer::write
+ * @param data
+ * @param size
+ * @param offset
+ * @param bytesWritten
+ * @return
+ *
+ * Writing past the end grows the file.
+ */
+
+bool SpoolFileBuffer::write(const uint8_t *data, uint32_t size, uint32_t offset, uint32_t *bytesWritten)
+{
+    if (m_fd == -1 || !data) {
+
+        return false;
+    }
+
+    if ((uint64_t)offset + size > UINT32_MAX) {
+
+        return false;
+    }
+
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        ssize_t r = pwrite(m_fd, data + s, size - s, offset + s);
+
+        if (r <= 0) {
+
+            return false;
+        }
+
+        s += r;
+    }
+
+    if (offset + size > m_size) {
+
+        m_size = offset + size;
+    }
+
+    if (bytesWritten) {
+
+        *bytesWritten = size;
+    }
+
+    return true;
+}
+
+/**
+ * @brief SpoolFileBuffer::fd
+ * @return
+ */
+
+int32_t SpoolFileBuffer::fd()
+{
+    return m_fd;
+}
+
+// ============================================================ //
+
+}
@@ -197,6 +197,71 @@ bool Store::setConfig(const UBJ::Object &config)
     return true;
 }
 
+/**
+ * @brief Store::tlsSession
+ * @param peer
+ * @return
+ *
+ * Session data for resuming tls connections to the peer. It is kept
+ * in the data blob, the config blob is uploaded to the server.
+ */
+
+MemoryBuffer$ Store::tlsSession(const std::string &peer)
+{
+    UBJ::Object data;
+
+    if (!getBlobData("blob1", Store::DataNodeId, data)) {
+
+        return nullptr;
+    }
+
+    UBJ::Object sessions = data["tlsSessions"].toObject();
+
+    if (!sessions.hasField(peer)) {
+
+        return nullptr;
+    }
+
+    return sessions[peer].buffer();
+}
+
+/**
+ * @brief Store::setTlsSession
+ * @param peer
+ * @param session null to remove it
+ * @return
+ */
+
+bool Store::setTlsSession(const std::string &peer, MemoryBuffer$ session)
+{
+    UBJ::Object data;
+
+    if (!getBlobData("blob1", Store::DataNodeId, data)) {
+
+        return false;
+    }
+
+    UBJ::Object sessions = data["tlsSessions"].toObject();
+
+    if (session) {
+
+        sessions[peer] = session;
+    }
+    else {
+
+        sessions.erase(peer);
+    }
+
+    data["tlsSessions"] = sessions;
+
+    if (!updateBlobData("blob1", Store::DataNodeId, data)) {
+
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * @brief Store::createVfsNode
  * @param type
@@ -991,7 +1056,9 @@ bool Store::createVTables()
                  "name",
                  "size",
                  "hash",
-                 "data"},
+                 "data",
+                 "part",
+                 "partSize"},
                 {"INTEGER",
                  "INTEGER",
                  "INTEGER",
@@ -1000,6 +1067,8 @@ bool Store::createVTables()
                  "TEXT",
                  "INTEGER",
                  "TEXT",
+                 "INTEGER",
+                 "INTEGER",
                  "INTEGER"})) {
 
         return false;
@@ -37,6 +37,7 @@ namespace Zway {
 StreamReceiver::StreamReceiver()
     : m_id(0),
       m_type(Packet::Undefined),
+      m_flags(0),
       m_status(Idle),
       m_part(0),
       m_parts(0)
@@ -58,7 +59,12 @@ bool StreamReceiver::init(const Packet &pkt)
 
     m_type = pkt.streamType();
 
-    m_part = pkt.part();
+    m_flags = pkt.streamFlags();
+
+    // a stream may be resumed at a later part, the part
+    // before it is taken as already processed
+
+    m_part = pkt.part() ? pkt.part() - 1 : 0;
 
     m_parts = pkt.parts();
 
@@ -110,6 +116,22 @@ bool StreamReceiver::process(Packet &pkt)
     return true;
 }
 
+/**
+ * @brief StreamReceiver::packetBuffer
+ * @param pkt
+ * @param offset
+ * @return
+ *
+ * Returns the buffer (and offset within) the body of the given packet
+ * can be received into directly, or nullptr if the receiver has no such
+ * location. Called from the receiving thread.
+ */
+
+MemoryBuffer$ StreamReceiver::packetBuffer(const Packet &, uint32_t &)
+{
+    return nullptr;
+}
+
 /**
  * @brief StreamReceiver::processPacket
  * @param pkt
@@ -150,6 +172,16 @@ Packet::StreamType StreamReceiver::type()
     return m_type;
 }
 
+/**
+ * @brief StreamReceiver::flags
+ * @return
+ */
+
+uint32_t StreamReceiver::flags()
+{
+    return m_flags;
+}
+
 /**
  * @brief StreamReceiver::status
  * @return
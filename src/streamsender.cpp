@@ -25,6 +25,7 @@
 // ============================================================ //
 
 #include "Zway/streamsender.h"
+#include "Zway/bufferpool.h"
 #include "Zway/memorybuffer.h"
 
 namespace Zway {
@@ -46,11 +47,16 @@ StreamSender::StreamSender(
         StreamSenderCallback callback)
     : m_id(id),
       m_type(type),
+      m_flags(0),
       m_status(Idle),
       m_callback(callback),
       m_size(0),
       m_part(0),
-      m_parts(parts)
+      m_parts(parts),
+      m_bodySize(MAX_PACKET_BODY),
+      m_quantum(0),
+      m_deficit(0),
+      m_epoch(0)
 {
 
 }
@@ -63,23 +69,11 @@ StreamSender::StreamSender(
 
 bool StreamSender::init(uint32_t streamSize)
 {
-    m_body = MemoryBuffer::create(nullptr, MAX_PACKET_BODY);
-
-    if (!m_body) {
-
-        return false;
-    }
-
     if (streamSize) {
 
         m_size = streamSize;
 
-        m_parts = 1;
-
-        if (m_size >= MAX_PACKET_BODY) {
-
-            m_parts = m_size / MAX_PACKET_BODY + (streamSize % MAX_PACKET_BODY ? 1 : 0);
-        }
+        m_parts = Packet::numParts(m_size, m_bodySize);
     }
 
     return true;
@@ -102,11 +96,28 @@ StreamSender::~StreamSender()
 
 bool StreamSender::process(Packet$ &pkt)
 {
-    uint32_t bytesSent = m_part * MAX_PACKET_BODY;
+    uint32_t bytesSent = m_part * m_bodySize;
+
+    uint32_t bytesToSend = m_size > 0 && m_size - bytesSent < m_bodySize ? m_size - bytesSent : m_bodySize;
+
+    // lease body buffer, it is handed over to the packet and
+    // returns to the pool once the packet has been sent
 
-    uint32_t bytesToSend = m_size > 0 && m_size - bytesSent < MAX_PACKET_BODY ? m_size - bytesSent : MAX_PACKET_BODY;
+    if (leasesBody()) {
 
-    m_body->clear();
+        BufferPool$ pool = BufferPool::packetPool(bytesToSend);
+
+        m_body = pool ? pool->lease() : nullptr;
+
+        if (!m_body) {
+
+            m_status = Error;
+
+            invokeCallback();
+
+            return false;
+        }
+    }
 
     // create packet
 
@@ -150,6 +161,8 @@ bool StreamSender::process(Packet$ &pkt)
         m_part++;
     }
 
+    m_body.reset();
+
     // TODO make completed decision in subclass
 
     if (m_parts > 0 && m_part == m_parts) {
@@ -158,7 +171,21 @@ bool StreamSender::process(Packet$ &pkt)
 
         invokeCallback();
     }
+    else {
+
+        m_status = Outgoing;
+    }
+
+    return true;
+}
+
+/**
+ * @brief StreamSender::leasesBody
+ * @return false if preparePacket() sets a body of its own
+ */
 
+bool StreamSender::leasesBody()
+{
     return true;
 }
 
@@ -174,6 +201,8 @@ bool StreamSender::preparePacket(Packet$ &pkt, uint32_t bytesToSend, uint32_t by
 
     pkt->setStreamType(m_type);
 
+    pkt->setStreamFlags(m_flags);
+
     pkt->setPart(m_part+1);
 
     pkt->setParts(m_parts);
@@ -204,6 +233,19 @@ void StreamSender::invokeCallback()
     }
 }
 
+/**
+ * @brief StreamSender::fail
+ *
+ * Ends a stream which won't be continued.
+ */
+
+void StreamSender::fail()
+{
+    m_status = Error;
+
+    invokeCallback();
+}
+
 /**
  * @brief StreamSender::id
  * @return
@@ -224,6 +266,16 @@ Packet::StreamType StreamSender::type()
     return m_type;
 }
 
+/**
+ * @brief StreamSender::flags
+ * @return
+ */
+
+uint32_t StreamSender::flags()
+{
+    return m_flags;
+}
+
 /**
  * @brief StreamSender::status
  * @return
@@ -254,6 +306,174 @@ uint32_t StreamSender::parts()
     return m_parts;
 }
 
+/**
+ * @brief StreamSender::bodySize
+ * @return
+ */
+
+uint32_t StreamSender::bodySize()
+{
+    return m_bodySize;
+}
+
+/**
+ * @brief StreamSender::setBodySize
+ * @param size
+ * @return
+ */
+
+bool StreamSender::setBodySize(uint32_t size)
+{
+    // the body size can't be changed once the stream has started
+
+    if (m_part > 0 || m_status != Idle) {
+
+        return false;
+    }
+
+    if (size < MIN_PACKET_BODY || size > MAX_JUMBO_PACKET_BODY) {
+
+        return false;
+    }
+
+    m_bodySize = size;
+
+    if (m_size) {
+
+        m_parts = Packet::numParts(m_size, m_bodySize);
+    }
+
+    return true;
+}
+
+/**
+ * @brief StreamSender::setStartPart
+ * @param part
+ * @return
+ *
+ * Skips the parts before the given one, used to resume a stream the
+ * receiver already has the beginning of.
+ */
+
+bool StreamSender::setStartPart(uint32_t part)
+{
+    if (m_part > 0 || m_status != Idle) {
+
+        return false;
+    }
+
+    if (!part || !m_parts || part > m_parts) {
+
+        return false;
+    }
+
+    m_part = part - 1;
+
+    return true;
+}
+
+/**
+ * @brief StreamSender::quantum
+ * @return
+ */
+
+uint32_t StreamSender::quantum()
+{
+    // by default a stream gets one packet per scheduling round
+
+    return m_quantum ? m_quantum : m_bodySize;
+}
+
+/**
+ * @brief StreamSender::setQuantum
+ * @param quantum
+ */
+
+void StreamSender::setQuantum(uint32_t quantum)
+{
+    m_quantum = quantum;
+}
+
+// ============================================================ //
+
+/**
+ * @brief StreamSenderQueue::StreamSenderQueue
+ */
+
+StreamSenderQueue::StreamSenderQueue()
+{
+
+}
+
+/**
+ * @brief StreamSenderQueue::~StreamSenderQueue
+ */
+
+StreamSenderQueue::~StreamSenderQueue()
+{
+    clear();
+}
+
+/**
+ * @brief StreamSenderQueue::push
+ * @param sender
+ */
+
+void StreamSenderQueue::push(StreamSender$ sender)
+{
+    sender->m_queueRef = sender;
+
+    m_queue.push(sender.get());
+}
+
+/**
+ * @brief StreamSenderQueue::pop
+ * @return
+ */
+
+StreamSender$ StreamSenderQueue::pop()
+{
+    StreamSender *sender = m_queue.pop();
+
+    if (!sender) {
+
+        return nullptr;
+    }
+
+    return std::move(sender->m_queueRef);
+}
+
+/**
+ * @brief StreamSenderQueue::clear
+ */
+
+void StreamSenderQueue::clear()
+{
+    while (pop()) {
+
+    }
+}
+
+/**
+ * @brief StreamSenderQueue::empty
+ * @return
+ */
+
+bool StreamSenderQueue::empty()
+{
+    return m_queue.empty();
+}
+
+/**
+ * @brief StreamSenderQueue::size
+ * @return
+ */
+
+uint32_t StreamSenderQueue::size()
+{
+    return m_queue.size();
+}
+
 // ============================================================ //
 
 }
@@ -0,0 +1,387 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/thread/executor.h"
+#include "Zway/thread/safe.h"
+
+#include <algorithm>
+
+namespace Zway {
+
+const uint32_t MAX_EXECUTOR_THREADS = 8;
+
+// ============================================================ //
+
+/**
+ * @brief Executor::defaultThreads
+ * @return the number of threads started if none is given
+ */
+
+uint32_t Executor::defaultThreads()
+{
+    uint32_t numThreads = std::thread::hardware_concurrency();
+
+    if (numThreads < 2) {
+
+        numThreads = 2;
+    }
+
+    if (numThreads > MAX_EXECUTOR_THREADS) {
+
+        numThreads = MAX_EXECUTOR_THREADS;
+    }
+
+    return numThreads;
+}
+
+/**
+ * @brief Executor::instance
+ * @return
+ *
+ * Pool shared by background work of the whole process.
+ */
+
+Executor$ Executor::instance()
+{
+    static Executor$ executor = [] () {
+
+        Executor$ executor(new Executor());
+
+        executor->start();
+
+        return executor;
+    }();
+
+    return executor;
+}
+
+/**
+ * @brief Executor::Executor
+ */
+
+Executor::Executor()
+    : m_numPending(0),
+      m_maxThreads(0),
+      m_numIdle(0),
+      m_running(false)
+{
+
+}
+
+/**
+ * @brief Executor::~Executor
+ */
+
+Executor::~Executor()
+{
+    stop();
+}
+
+/**
+ * @brief Executor::start
+ * @param numThreads most threads to run, 0 for one per core, up to MAX_EXECUTOR_THREADS
+ * @return
+ *
+ * No thread is started before there is a task for it.
+ */
+
+bool Executor::start(uint32_t numThreads)
+{
+    MutexLocker locker(m_mutex);
+
+    if (m_running) {
+
+        return false;
+    }
+
+    if (!numThreads) {
+
+        numThreads = defaultThreads();
+    }
+
+    m_maxThreads = numThreads;
+
+    m_running = true;
+
+    return true;
+}
+
+/**
+ * @brief Executor::stop
+ *
+ * Waits for the running tasks, pending tasks are dropped.
+ */
+
+void Executor::stop()
+{
+    std::vector<std::thread> threads;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        m_running = false;
+
+        m_lanes.clear();
+
+        m_ready.clear();
+
+        m_numPending = 0;
+
+        threads.swap(m_threads);
+
+        m_condition.notify_all();
+    }
+
+    for (auto &it : threads) {
+
+        it.join();
+    }
+}
+
+/**
+ * @brief Executor::post
+ * @param key
+ * @param task
+ * @param group
+ * @return false if the executor isn't running
+ */
+
+bool Executor::post(uint64_t key, Task task, uint64_t group)
+{
+    MutexLocker locker(m_mutex);
+
+    if (!m_running) {
+
+        return false;
+    }
+
+    // a key is either in the ready queue or being worked on
+    // as long as its lane exists
+
+    auto it = m_lanes.find(key);
+
+    if (it == m_lanes.end()) {
+
+        it = m_lanes.emplace(key, Lane()).first;
+
+        m_ready.push_back(key);
+
+        // another thread if the idle ones can't take the ready keys
+
+        if (m_ready.size() > m_numIdle && m_threads.size() < m_maxThreads) {
+
+            m_threads.emplace_back(&Executor::run, this);
+        }
+        else {
+
+            m_condition.notify_one();
+        }
+    }
+
+    it->second.tasks.push_back({std::move(task), group});
+
+    m_numPending++;
+
+    return true;
+}
+
+/**
+ * @brief Executor::cancel
+ * @param group
+ *
+ * Drops the pending tasks of the group and waits for its running ones,
+ * except one run by the calling thread.
+ */
+
+void Executor::cancel(uint64_t group)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (auto it = m_lanes.begin(); it != m_lanes.end();) {
+
+        auto &tasks = it->second.tasks;
+
+        uint32_t size = tasks.size();
+
+        tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [group] (const Item &item) {
+
+            return item.group == group;
+        }), tasks.end());
+
+        m_numPending -= size - tasks.size();
+
+        // a lane being worked on is cleaned up by its thread
+
+        auto ready = std::find(m_ready.begin(), m_ready.end(), it->first);
+
+        if (tasks.empty() && ready != m_ready.end()) {
+
+            m_ready.erase(ready);
+
+            it = m_lanes.erase(it);
+        }
+        else {
+
+            ++it;
+        }
+    }
+
+    std::thread::id self = std::this_thread::get_id();
+
+    m_finished.wait(lock, [this, group, self] () {
+
+        for (auto &it : m_active) {
+
+            if (it.second == group && it.first != self) {
+
+                return false;
+            }
+        }
+
+        return true;
+    });
+}
+
+/**
+ * @brief Executor::running
+ * @return
+ */
+
+bool Executor::running()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_running;
+}
+
+/**
+ * @brief Executor::numThreads
+ * @return
+ */
+
+uint32_t Executor::numThreads()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_threads.size();
+}
+
+/**
+ * @brief Executor::numPending
+ * @return
+ */
+
+uint32_t Executor::numPending()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_numPending;
+}
+
+/**
+ * @brief Executor::run
+ */
+
+void Executor::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+
+        m_numIdle++;
+
+        m_condition.wait(lock, [this] () {
+
+            return !m_running || !m_ready.empty();
+        });
+
+        m_numIdle--;
+
+        if (!m_running) {
+
+            break;
+        }
+
+        uint64_t key = m_ready.front();
+
+        m_ready.pop_front();
+
+        Item item = std::move(m_lanes[key].tasks.front());
+
+        m_lanes[key].tasks.pop_front();
+
+        m_numPending--;
+
+        m_active.emplace_back(std::this_thread::get_id(), item.group);
+
+        lock.unlock();
+
+        item.task();
+
+        item.task = nullptr;
+
+        lock.lock();
+
+        for (auto it = m_active.begin(); it != m_active.end(); ++it) {
+
+            if (it->first == std::this_thread::get_id()) {
+
+                m_active.erase(it);
+
+                break;
+            }
+        }
+
+        m_finished.notify_all();
+
+        if (!m_running) {
+
+            break;
+        }
+
+        // back in line if more tasks were posted for the key meanwhile
+
+        auto it = m_lanes.find(key);
+
+        if (it != m_lanes.end()) {
+
+            if (it->second.tasks.empty()) {
+
+                m_lanes.erase(it);
+            }
+            else {
+
+                m_ready.push_back(key);
+
+                m_condition.notify_one();
+            }
+        }
+    }
+}
+
+// ============================================================ //
+
+}
@@ -35,12 +35,11 @@ namespace Zway {
  */
 
 Thread::Thread()
+    : m_running(false),
+      m_suspended(false),
+      m_canceled(false)
 {
-    m_running = false;
-
-    m_suspended = false;
 
-    m_canceled = false;
 }
 
 /**
@@ -60,16 +59,10 @@ void Thread::start(bool paused)
 {
     if (!running()) {
 
-        {
-            MutexLocker lock(m_canceled);
-
-            m_canceled = false;
-        }
+        m_canceled = false;
 
         if (paused) {
 
-            MutexLocker lock(m_suspended);
-
             m_suspended = true;
         }
 
@@ -85,8 +78,6 @@ void Thread::suspend()
 {
     if (running()) {
 
-        MutexLocker lock(m_suspended);
-
         m_suspended = true;
     }
 }
@@ -99,17 +90,13 @@ void Thread::resume()
 {
     if (running() && suspended()) {
 
-        {
-            MutexLocker lock(m_suspended);
+        // cleared under the mutex, waitResume tests it under the mutex
 
-            m_suspended = false;
-        }
+        std::unique_lock<std::mutex> lock(m_waitResumeMutex);
 
-        {
-            std::unique_lock<std::mutex> lock(m_waitResumeMutex);
+        m_suspended = false;
 
-            m_waitResumeCondition.notify_one();
-        }
+        m_waitResumeCondition.notify_one();
     }
 }
 
@@ -119,11 +106,7 @@ void Thread::resume()
 
 void Thread::cancel()
 {
-    {
-        MutexLocker lock(m_canceled);
-
-        m_canceled = true;
-    }
+    m_canceled = true;
 
     resume();
 }
@@ -154,13 +137,19 @@ void Thread::cancelAndJoin()
 
 /**
  * @brief Thread::waitResume
+ *
+ * Returns at once if resumed or canceled meanwhile, a resume between
+ * checking suspended() and waiting would be lost otherwise.
  */
 
 void Thread::waitResume()
 {
     std::unique_lock<std::mutex> lock(m_waitResumeMutex);
 
-    m_waitResumeCondition.wait(lock);
+    m_waitResumeCondition.wait(lock, [this] () {
+
+        return !suspended() || canceled();
+    });
 }
 
 /**
@@ -170,8 +159,6 @@ void Thread::waitResume()
 
 bool Thread::running()
 {
-    MutexLocker lock(m_running);
-
     return m_running;
 }
 
@@ -182,8 +169,6 @@ bool Thread::running()
 
 bool Thread::suspended()
 {
-    MutexLocker lock(m_suspended);
-
     return m_suspended;
 }
 
@@ -194,8 +179,6 @@ bool Thread::suspended()
 
 bool Thread::canceled()
 {
-    MutexLocker lock(m_canceled);
-
     return m_canceled;
 }
 
@@ -215,19 +198,11 @@ std::thread::id Thread::threadId()
 
 void Thread::doRun()
 {
-    {
-        MutexLocker lock(m_running);
-
-        m_running = true;
-    }
+    m_running = true;
 
     run();
 
-    {
-        MutexLocker lock(m_running);
-
-        m_running = false;
-    }
+    m_running = false;
 }
 
 // ============================================================ //
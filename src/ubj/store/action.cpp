@@ -42,10 +42,9 @@ Action::Action(Store$ store, const std::string &table)
     : m_store(store),
       m_table(table),
       m_vtab(false),
-      m_stmt(nullptr)
+      m_stmt(nullptr),
+      m_done(false)
 {
-    m_done = false;
-
     m_vtab = store->m_vtabs.find(table) != store->m_vtabs.end();
 }
 
@@ -111,22 +110,19 @@ void Action::finish()
 
 /**
  * @brief Action::wait
+ *
+ * The done flag is tested under the wait mutex, a notify between the
+ * test and the wait can't get lost and spurious wake-ups don't return.
  */
 
 void Action::wait()
 {
-    {
-        MutexLocker lock(m_done);
-
-        if (m_done) {
-
-            return;
-        }
-    }
+    std::unique_lock<std::mutex> lock(m_waitMutex);
 
-    std::unique_lock<std::mutex>lock(m_waitMutex);
+    m_waitCondition.wait(lock, [this] () {
 
-    m_waitCondition.wait(lock);
+        return m_done.load();
+    });
 }
 
 /**
@@ -549,13 +545,9 @@ void Action::notify()
 {
     std::unique_lock<std::mutex> lock(m_waitMutex);
 
-    m_waitCondition.notify_one();
-
-    {
-        MutexLocker lock(m_done);
+    m_done = true;
 
-        m_done = true;
-    }
+    m_waitCondition.notify_one();
 }
 
 // ============================================================ //
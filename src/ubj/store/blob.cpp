@@ -40,6 +40,7 @@ namespace Zway { namespace UBJ {
 Store::Blob::Blob(Store$ store)
     : m_store(store),
       m_id(0),
+      m_readOnly(true),
       m_mode(false),
       m_blob(nullptr)
 {
@@ -86,8 +87,12 @@ bool Store::Blob::open(const std::string &table, uint64_t id, bool readOnly, boo
         return false;
     }
 
+    m_table = table;
+
     m_id = id;
 
+    m_readOnly = readOnly;
+
     if (meta) {
 
         m_mode = info["mode"].toInt();
@@ -264,6 +269,47 @@ bool Store::Blob::close()
     return true;
 }
 
+/**
+ * @brief Store::Blob::reopen
+ * @return
+ *
+ * Opens a closed blob again, the cipher restarts at offset 0.
+ */
+
+bool Store::Blob::reopen()
+{
+    if (m_blob || !m_id) {
+
+        return false;
+    }
+
+    return open(m_table, m_id, m_readOnly, false, m_mode, m_size, m_salt);
+}
+
+/**
+ * @brief Store::Blob::seek
+ * @param offset
+ * @return
+ *
+ * Moves the cipher to the given offset, so that the following read
+ * or write can start there instead of at the beginning of the blob.
+ */
+
+bool Store::Blob::seek(uint32_t offset)
+{
+    if (!m_blob || offset > m_size) {
+
+        return false;
+    }
+
+    if (m_mode) {
+
+        return m_aes.setCtr(m_salt, offset);
+    }
+
+    return true;
+}
+
 /**
  * @brief Store::Blob::id
  * @return
@@ -27,8 +27,12 @@
 #include "Zway/ubjreceiver.h"
 #include "Zway/memorybuffer.h"
 
+#include <zlib.h>
+
 namespace Zway {
 
+const uint32_t MAX_INFLATED_SIZE = 67108864;
+
 // ============================================================ //
 
 /**
@@ -77,6 +81,21 @@ bool UbjReceiver::processPacket(Packet &pkt)
 
     if (pkt.part() == pkt.parts()) {
 
+        if (m_flags & Packet::Compressed) {
+
+            MemoryBuffer$ buffer = inflate(m_buffer->data(), m_bytesReceived);
+
+            if (!buffer) {
+
+                return false;
+            }
+
+            if (!UBJ::Value::read(m_value, buffer)) {
+
+                // ...
+            }
+        }
+        else
         if (!UBJ::Value::read(m_value, m_buffer->data(), m_bytesReceived)) {
 
             // ...
@@ -108,6 +127,49 @@ void UbjReceiver::invokeCallback()
     }
 }
 
+/**
+ * @brief UbjReceiver::inflate
+ * @param data
+ * @param size
+ * @return
+ */
+
+MemoryBuffer$ UbjReceiver::inflate(const uint8_t *data, uint32_t size)
+{
+    if (size <= sizeof(uint32_t)) {
+
+        return nullptr;
+    }
+
+    uint32_t inflatedSize = *(uint32_t*)data;
+
+    if (!inflatedSize || inflatedSize > MAX_INFLATED_SIZE) {
+
+        return nullptr;
+    }
+
+    MemoryBuffer$ buffer = MemoryBuffer::create(nullptr, inflatedSize);
+
+    if (!buffer) {
+
+        return nullptr;
+    }
+
+    uLongf bufferSize = inflatedSize;
+
+    if (uncompress(buffer->data(), &bufferSize, data + sizeof(uint32_t), size - sizeof(uint32_t)) != Z_OK) {
+
+        return nullptr;
+    }
+
+    if (bufferSize != inflatedSize) {
+
+        return nullptr;
+    }
+
+    return buffer;
+}
+
 // ============================================================ //
 
 }
@@ -27,8 +27,12 @@
 #include "Zway/ubjsender.h"
 #include "Zway/memorybuffer.h"
 
+#include <zlib.h>
+
 namespace Zway {
 
+const uint32_t UBJ_COMPRESSION_THRESHOLD = 1024;
+
 // ============================================================ //
 
 /**
@@ -37,6 +41,7 @@ namespace Zway {
  * @param type
  * @param value
  * @param callback
+ * @param compress
  * @return
  */
 
@@ -44,11 +49,12 @@ UbjSender$ UbjSender::create(
         uint32_t id,
         Packet::StreamType type,
         const UBJ::Value &value,
-        StreamSenderCallback callback)
+        StreamSenderCallback callback,
+        bool compress)
 {
     UbjSender$ sender(new UbjSender(id, type, value, callback));
 
-    if (!sender->init(value)) {
+    if (!sender->init(value, compress)) {
 
         return nullptr;
     }
@@ -77,18 +83,36 @@ UbjSender::UbjSender(
 /**
  * @brief UbjSender::init
  * @param value
+ * @param compress
  * @return
  */
 
-bool UbjSender::init(const UBJ::Value &value)
+bool UbjSender::init(const UBJ::Value &value, bool compress)
 {
-    m_buffer = UBJ::Value::write(value);
+    MemoryBuffer$ buffer = UBJ::Value::write(value);
 
-    if (!m_buffer) {
+    if (!buffer) {
 
         return false;
     }
 
+    // deflate larger objects, small ones are sent as they are
+    // and so are those which don't get any smaller
+
+    if (compress && buffer->size() >= UBJ_COMPRESSION_THRESHOLD) {
+
+        MemoryBuffer$ deflated = deflate(buffer);
+
+        if (deflated && deflated->size() < buffer->size()) {
+
+            buffer = deflated;
+
+            m_flags |= Packet::Compressed;
+        }
+    }
+
+    m_buffer = buffer;
+
     if (!BufferSender::init()) {
 
         return false;
@@ -97,6 +121,35 @@ bool UbjSender::init(const UBJ::Value &value)
     return true;
 }
 
+/**
+ * @brief UbjSender::deflate
+ * @param buffer
+ * @return
+ */
+
+MemoryBuffer$ UbjSender::deflate(MemoryBuffer$ buffer)
+{
+    // compressed data is prefixed with the uncompressed size
+
+    uLongf size = compressBound(buffer->size());
+
+    MemoryBuffer$ tmp = MemoryBuffer::create(nullptr, sizeof(uint32_t) + size);
+
+    if (!tmp) {
+
+        return nullptr;
+    }
+
+    if (compress(tmp->data() + sizeof(uint32_t), &size, buffer->data(), buffer->size()) != Z_OK) {
+
+        return nullptr;
+    }
+
+    *(uint32_t*)tmp->data() = buffer->size();
+
+    return MemoryBuffer::create(tmp->data(), sizeof(uint32_t) + size);
+}
+
 // ============================================================ //
 
 }
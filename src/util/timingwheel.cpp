@@ -0,0 +1,361 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/util/timingwheel.h"
+
+#include <chrono>
+#include <cstdint>
+
+namespace Zway {
+
+// ============================================================ //
+
+// 256 slots of 1 ms in the innermost wheel, 64 slots in each of the
+// outer ones, which covers deadlines up to 2^32 ms ahead
+
+static const uint32_t WHEEL_BITS[] = {8, 6, 6, 6, 6};
+
+static const uint32_t NUM_WHEELS = sizeof(WHEEL_BITS) / sizeof(WHEEL_BITS[0]);
+
+/**
+ * @brief wheelShift
+ * @param level
+ * @return
+ */
+
+static uint32_t wheelShift(uint32_t level)
+{
+    uint32_t shift = 0;
+
+    for (uint32_t i=0; i<level; ++i) {
+
+        shift += WHEEL_BITS[i];
+    }
+
+    return shift;
+}
+
+/**
+ * @brief TimingWheel::now
+ * @return
+ */
+
+uint64_t TimingWheel::now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief TimingWheel::TimingWheel
+ */
+
+TimingWheel::TimingWheel()
+    : m_tick(now()),
+      m_counts(NUM_WHEELS, 0)
+{
+    for (uint32_t i=0; i<NUM_WHEELS; ++i) {
+
+        m_wheels.push_back(std::vector<std::list<uint32_t>>(1 << WHEEL_BITS[i]));
+    }
+}
+
+/**
+ * @brief TimingWheel::add
+ * @param id
+ * @param deadline
+ * @return
+ *
+ * Adds a timer or moves an existing one to a new deadline.
+ */
+
+bool TimingWheel::add(uint32_t id, uint64_t deadline)
+{
+    cancel(id);
+
+    Timer &timer = m_timers[id];
+
+    timer.deadline = deadline;
+
+    insert(id, timer);
+
+    return true;
+}
+
+/**
+ * @brief TimingWheel::cancel
+ * @param id
+ * @return
+ */
+
+bool TimingWheel::cancel(uint32_t id)
+{
+    auto it = m_timers.find(id);
+
+    if (it == m_timers.end()) {
+
+        return false;
+    }
+
+    Timer &timer = it->second;
+
+    m_wheels[timer.level][timer.slot].erase(timer.it);
+
+    m_counts[timer.level]--;
+
+    m_timers.erase(it);
+
+    return true;
+}
+
+/**
+ * @brief TimingWheel::clear
+ */
+
+void TimingWheel::clear()
+{
+    for (uint32_t i=0; i<NUM_WHEELS; ++i) {
+
+        for (auto &slot : m_wheels[i]) {
+
+            slot.clear();
+        }
+
+        m_counts[i] = 0;
+    }
+
+    m_timers.clear();
+}
+
+/**
+ * @brief TimingWheel::insert
+ * @param id
+ * @param timer
+ */
+
+void TimingWheel::insert(uint32_t id, Timer &timer)
+{
+    // overdue timers go to the current slot and expire next
+
+    uint64_t deadline = timer.deadline > m_tick ? timer.deadline : m_tick;
+
+    uint64_t delta = deadline - m_tick;
+
+    uint32_t level = 0;
+
+    while (level < NUM_WHEELS - 1 && delta >> wheelShift(level + 1)) {
+
+        level++;
+    }
+
+    if (level == NUM_WHEELS - 1 && delta >> wheelShift(NUM_WHEELS)) {
+
+        // beyond the outermost wheel, park it in its last slot
+
+        deadline = m_tick + ((uint64_t)1 << wheelShift(NUM_WHEELS)) - 1;
+    }
+
+    uint32_t slot = (deadline >> wheelShift(level)) & ((1 << WHEEL_BITS[level]) - 1);
+
+    std::list<uint32_t> &list = m_wheels[level][slot];
+
+    timer.level = level;
+
+    timer.slot = slot;
+
+    timer.it = list.insert(list.end(), id);
+
+    m_counts[level]++;
+}
+
+/**
+ * @brief TimingWheel::cascade
+ * @param level
+ *
+ * Moves the timers of the current slot of an outer wheel inwards.
+ */
+
+void TimingWheel::cascade(uint32_t level)
+{
+    uint32_t slot = (m_tick >> wheelShift(level)) & ((1 << WHEEL_BITS[level]) - 1);
+
+    std::list<uint32_t> list;
+
+    list.swap(m_wheels[level][slot]);
+
+    m_counts[level] -= list.size();
+
+    for (auto id : list) {
+
+        insert(id, m_timers[id]);
+    }
+}
+
+/**
+ * @brief TimingWheel::advance
+ * @param time
+ * @param callback
+ * @return
+ *
+ * Expires all timers with a deadline up to and including time and
+ * returns their number. The callback may add or cancel timers.
+ */
+
+uint32_t TimingWheel::advance(uint64_t time, const ExpireCallback &callback)
+{
+    uint32_t res = 0;
+
+    while (m_tick <= time) {
+
+        if (m_timers.empty()) {
+
+            m_tick = time + 1;
+
+            break;
+        }
+
+        uint32_t slot = m_tick & ((1 << WHEEL_BITS[0]) - 1);
+
+        // entering a new round of an inner wheel pulls in the
+        // timers of the next slot of the wheel around it
+
+        if (slot == 0) {
+
+            for (uint32_t level=1; level<NUM_WHEELS; ++level) {
+
+                cascade(level);
+
+                if ((m_tick >> wheelShift(level)) & ((1 << WHEEL_BITS[level]) - 1)) {
+
+                    break;
+                }
+            }
+        }
+
+        // skip ahead to the next round when the inner wheel is empty
+
+        if (!m_counts[0]) {
+
+            uint64_t next = (m_tick | ((1 << WHEEL_BITS[0]) - 1)) + 1;
+
+            m_tick = next <= time ? next : time + 1;
+
+            continue;
+        }
+
+        std::list<uint32_t> expired;
+
+        expired.swap(m_wheels[0][slot]);
+
+        m_counts[0] -= expired.size();
+
+        for (auto id : expired) {
+
+            m_timers.erase(id);
+        }
+
+        m_tick++;
+
+        for (auto id : expired) {
+
+            if (callback) {
+
+                callback(id);
+            }
+
+            res++;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * @brief TimingWheel::nextDeadline
+ * @return
+ *
+ * Returns the earliest deadline of the inner wheel or the start of the
+ * first occupied slot of an outer wheel, whichever comes first. Slot
+ * starts are never later than the deadlines in them, so the result is
+ * a safe time to advance to. Returns 0 if there are no timers.
+ */
+
+uint64_t TimingWheel::nextDeadline()
+{
+    if (m_timers.empty()) {
+
+        return 0;
+    }
+
+    uint64_t res = UINT64_MAX;
+
+    for (uint32_t level=0; level<NUM_WHEELS; ++level) {
+
+        if (!m_counts[level]) {
+
+            continue;
+        }
+
+        uint32_t shift = wheelShift(level);
+
+        uint32_t numSlots = 1 << WHEEL_BITS[level];
+
+        uint64_t base = m_tick >> shift;
+
+        for (uint32_t i=0; i<numSlots; ++i) {
+
+            uint64_t pos = base + i;
+
+            if (!m_wheels[level][pos & (numSlots - 1)].empty()) {
+
+                uint64_t start = pos << shift;
+
+                if (start < res) {
+
+                    res = start;
+                }
+
+                break;
+            }
+        }
+    }
+
+    return res > m_tick ? res : m_tick;
+}
+
+/**
+ * @brief TimingWheel::size
+ * @return
+ */
+
+uint32_t TimingWheel::size()
+{
+    return m_timers.size();
+}
+
+// ============================================================ //
+
+}